@@ -0,0 +1,79 @@
+#include "blob_pool.h"
+
+// std::unique_lock that only locks for a locked pool
+static std::unique_lock<std::mutex> guard(std::mutex &lock, bool locked) {
+    return locked ? std::unique_lock<std::mutex>(lock) : std::unique_lock<std::mutex>();
+}
+
+BlobPool::BlobPool(bool locked_, size_t max_cached) : locked(locked_), maxCached(max_cached) {}
+
+BlobPool::~BlobPool() {
+    // blobs still out when the pool goes away are leaked, not freed under their owner
+    clear();
+}
+
+void *BlobPool::fastMalloc(size_t size) {
+    auto hold = guard(lock, locked);
+    counters.requests++;
+    counters.requested_bytes += size;
+    // the smallest cached buffer that fits, wasting at most a quarter of it
+    auto best = budgets.end();
+    for (auto it = budgets.begin(); it != budgets.end(); ++it) {
+        if (it->first >= size && size >= it->first - it->first / 4
+            && (best == budgets.end() || it->first < best->first))
+            best = it;
+    }
+    if (best != budgets.end()) {
+        void *ptr = best->second;
+        payouts[ptr] = best->first;
+        cachedBytes -= best->first;
+        budgets.erase(best);
+        counters.hits++;
+        return ptr;
+    }
+    void *ptr = ncnn::fastMalloc(size);
+    if (ptr)
+        payouts[ptr] = size;
+    return ptr;
+}
+
+void BlobPool::fastFree(void *ptr) {
+    auto hold = guard(lock, locked);
+    auto it = payouts.find(ptr);
+    if (it == payouts.end()) {
+        ncnn::fastFree(ptr);
+        return;
+    }
+    budgets.emplace_back(it->second, ptr);
+    cachedBytes += it->second;
+    payouts.erase(it);
+    trim();
+}
+
+void BlobPool::trim() {
+    while (budgets.size() > maxCached) {
+        cachedBytes -= budgets.front().first;
+        ncnn::fastFree(budgets.front().second);
+        budgets.pop_front();
+    }
+}
+
+PoolStats BlobPool::stats() const {
+    auto hold = guard(lock, locked);
+    PoolStats s = counters;
+    s.cached_bytes = cachedBytes;
+    return s;
+}
+
+void BlobPool::resetStats() {
+    auto hold = guard(lock, locked);
+    counters = PoolStats();
+}
+
+void BlobPool::clear() {
+    auto hold = guard(lock, locked);
+    for (auto &budget : budgets)
+        ncnn::fastFree(budget.second);
+    budgets.clear();
+    cachedBytes = 0;
+}
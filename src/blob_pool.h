@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef __MTCNN_BLOB_POOL_H__
+#define __MTCNN_BLOB_POOL_H__
+
+#include "allocator.h"
+#include <mutex>
+#include <unordered_map>
+#include <list>
+
+struct PoolStats {
+    // allocations asked of the pool, and those served by a cached buffer
+    size_t requests;
+    size_t hits;
+    size_t requested_bytes;
+    // freed buffers the pool holds on to
+    size_t cached_bytes;
+};
+
+// ncnn allocator keeping freed buffers for the next request of a similar
+// size, like ncnn::PoolAllocator, but counting its hits and bounded to
+// max_cached free buffers (the oldest go back to the heap) so a stream of
+// changing image sizes does not grow it forever. Only a locked pool may be
+// used from several threads at once.
+class BlobPool : public ncnn::Allocator {
+public:
+    explicit BlobPool(bool locked, size_t max_cached = 64);
+
+    virtual ~BlobPool();
+
+    virtual void *fastMalloc(size_t size);
+
+    virtual void fastFree(void *ptr);
+
+    // totals since construction, or since the last resetStats
+    PoolStats stats() const;
+
+    void resetStats();
+
+    // returns every cached buffer to the heap
+    void clear();
+
+private:
+    void trim();
+
+    const bool locked;
+    const size_t maxCached;
+    mutable std::mutex lock;
+    // free buffers, oldest first
+    std::list<std::pair<size_t, void *> > budgets;
+    std::unordered_map<void *, size_t> payouts;
+    size_t cachedBytes = 0;
+    PoolStats counters = PoolStats();
+};
+
+#endif //__MTCNN_BLOB_POOL_H__
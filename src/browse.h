@@ -18,7 +18,7 @@ static void browse(const char *url)
 
 #endif
 
-#if linux || __FreeBSD__ || __sun&&__SVR4
+#if defined(__linux__) || defined(__FreeBSD__) || (defined(__sun) && defined(__SVR4))
 
 #include        <sys/types.h>
 #include        <sys/wait.h>
@@ -44,7 +44,7 @@ static void browse(const char *url)
     {
         execvp(args[0], (char**)args);
         perror(args[0]);                // failed to execute
-        return;
+        _exit(1);
     }
 }
 
@@ -83,7 +83,7 @@ static  void browse(const char *url)
     {
         execvp(args[0], (char**)args);
         perror(args[0]);                // failed to execute
-        return;
+        _exit(1);
     }
 }
 
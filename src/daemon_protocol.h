@@ -0,0 +1,119 @@
+#ifndef __MTCNN_DAEMON_PROTOCOL_H__
+#define __MTCNN_DAEMON_PROTOCOL_H__
+
+#include "mtcnn_c.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// Request/response framing of mtcnn_daemon, in host byte order since both
+// ends share the machine. A connection carries any number of requests:
+//   client: DaemonRequest, then size payload bytes
+//   daemon: DaemonResponse, then count mtcnn_face records
+
+static const uint32_t DAEMON_MAGIC = 0x4e43544d; // "MTCN"
+static const uint16_t DAEMON_VERSION = 1;
+static const uint32_t DAEMON_MAX_PAYLOAD = 64u << 20;
+
+enum DaemonFormat {
+    // width x height RGB888, packed rows
+    DAEMON_RGB = 0,
+    // any file stb_image decodes (jpeg, png, bmp, ...)
+    DAEMON_ENCODED = 1
+};
+
+enum DaemonStatus {
+    DAEMON_OK = 0,
+    DAEMON_BAD_REQUEST = -1,
+    DAEMON_DECODE_FAILED = -2,
+    DAEMON_DETECT_FAILED = -3
+};
+
+struct DaemonRequest {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t format;
+    int32_t width, height;
+    // 0 keeps the daemon default
+    int32_t min_face;
+    uint32_t size;
+};
+
+struct DaemonResponse {
+    uint32_t magic;
+    int32_t status;
+    uint32_t count;
+    // time spent in detect, decode excluded
+    float detect_ms;
+};
+
+static inline bool readFull(int fd, void *data, size_t size) {
+    char *p = (char *) data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static inline bool writeFull(int fd, const void *data, size_t size) {
+    const char *p = (const char *) data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static inline bool socketAddress(const char *path, sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+// returns -1 on failure
+static inline int daemonConnect(const char *path) {
+    sockaddr_un addr;
+    if (!socketAddress(path, addr))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (const sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// one request/response round trip, returns false if the connection broke
+static inline bool daemonDetect(int fd, DaemonFormat format, const void *payload, uint32_t size, int width,
+                                int height, int min_face, DaemonResponse &response, std::vector<mtcnn_face> &faces) {
+    DaemonRequest request = {DAEMON_MAGIC, DAEMON_VERSION, (uint16_t) format, width, height, min_face, size};
+    if (!writeFull(fd, &request, sizeof(request)) || !writeFull(fd, payload, size))
+        return false;
+    if (!readFull(fd, &response, sizeof(response)) || response.magic != DAEMON_MAGIC)
+        return false;
+    faces.resize(response.count);
+    return response.count == 0 || readFull(fd, faces.data(), response.count * sizeof(mtcnn_face));
+}
+
+#endif //__MTCNN_DAEMON_PROTOCOL_H__
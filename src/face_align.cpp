@@ -0,0 +1,177 @@
+#include "face_align.h"
+#include "pixel_convert.h"
+#include <stdint.h>
+#include <string.h>
+
+// landmark template of 112x112 chips
+static const float templatePoints[10] = {38.2946f, 73.5318f, 56.0252f, 41.5493f, 70.7299f,
+                                         51.6963f, 51.5014f, 71.7366f, 92.3655f, 92.2041f};
+
+FaceTransform solveFaceTransform(const float *landmarks, int size) {
+    const float scale = (float) size / ALIGNED_FACE_SIZE;
+    float px[5], py[5];
+    float pcx = 0, pcy = 0, qcx = 0, qcy = 0;
+    for (int i = 0; i < 5; i++) {
+        px[i] = templatePoints[i] * scale;
+        py[i] = templatePoints[i + 5] * scale;
+        pcx += px[i] / 5;
+        pcy += py[i] / 5;
+        qcx += landmarks[i] / 5;
+        qcy += landmarks[i + 5] / 5;
+    }
+    // least squares a, b of q - qc = [a -b; b a] (p - pc), no reflection
+    float dot = 0, cross = 0, norm = 0;
+    for (int i = 0; i < 5; i++) {
+        float ux = px[i] - pcx, uy = py[i] - pcy;
+        float vx = landmarks[i] - qcx, vy = landmarks[i + 5] - qcy;
+        dot += ux * vx + uy * vy;
+        cross += ux * vy - uy * vx;
+        norm += ux * ux + uy * uy;
+    }
+    FaceTransform t;
+    t.a = dot / norm;
+    t.b = cross / norm;
+    t.tx = qcx - (t.a * pcx - t.b * pcy);
+    t.ty = qcy - (t.b * pcx + t.a * pcy);
+    return t;
+}
+
+static inline float clampCoord(float v, float hi) {
+    return v < 0.f ? 0.f : (v > hi ? hi : v);
+}
+
+// one chip row of n pixels starting at image position x, y, stepping dx, dy
+typedef void (*WarpRow)(const ImageView &image, float x, float y, float dx, float dy, int n, unsigned char *dst);
+
+static void warpRowPacked(const ImageView &image, float x, float y, float dx, float dy, int n, unsigned char *dst) {
+    const int bpp = image.pixelBytes();
+    const bool bgr = image.format == PIXEL_FORMAT_BGR || image.format == PIXEL_FORMAT_BGRA;
+    const int r = bgr ? 2 : 0, b = bgr ? 0 : 2;
+    const float xmax = (float) (image.width - 1), ymax = (float) (image.height - 1);
+    for (int i = 0; i < n; i++, dst += 3) {
+        const float sx = clampCoord(x + dx * i, xmax), sy = clampCoord(y + dy * i, ymax);
+        const int x1 = (int) sx, y1 = (int) sy;
+        const int x2 = std::min(x1 + 1, image.width - 1), y2 = std::min(y1 + 1, image.height - 1);
+        const float fx = sx - x1, fy = sy - y1;
+        const unsigned char *p1 = image.data[0] + (size_t) y1 * image.stride[0];
+        const unsigned char *p2 = image.data[0] + (size_t) y2 * image.stride[0];
+        const int channel[3] = {r, 1, b};
+        for (int c = 0; c < 3; c++) {
+            const int k = channel[c];
+            float top = p1[x1 * bpp + k] + (p1[x2 * bpp + k] - p1[x1 * bpp + k]) * fx;
+            float bottom = p2[x1 * bpp + k] + (p2[x2 * bpp + k] - p2[x1 * bpp + k]) * fx;
+            dst[c] = toByte(top + (bottom - top) * fy);
+        }
+    }
+}
+
+// same conversion as pixel_sampler, see sampleYuv
+static void warpRowYUV(const ImageView &image, float x, float y, float dx, float dy, int n, unsigned char *dst) {
+    const YuvPlanes planes = image.yuvPlanes();
+    const float xmax = (float) (image.width - 1), ymax = (float) (image.height - 1);
+    for (int i = 0; i < n; i++, dst += 3) {
+        const float sx = clampCoord(x + dx * i, xmax), sy = clampCoord(y + dy * i, ymax);
+        const int x1 = (int) sx, y1 = (int) sy;
+        const int x2 = std::min(x1 + 1, image.width - 1), y2 = std::min(y1 + 1, image.height - 1);
+        const float fx = sx - x1, fy = sy - y1;
+        float rgb[3];
+        sampleYuv(planes, x1, x2, y1, y2, 1 - fx, fx, 1 - fy, fy, rgb);
+        dst[0] = toByte(rgb[0]);
+        dst[1] = toByte(rgb[1]);
+        dst[2] = toByte(rgb[2]);
+    }
+}
+
+#if defined(PIXEL_AVX2)
+
+// 8 chip pixels per step, each of the four taps is one 32 bit gather;
+// vectors that could read past the end of the image use the scalar code
+TARGET_AVX2 static void warpRowPackedAVX2(const ImageView &image, float x, float y, float dx, float dy, int n,
+                                          unsigned char *dst) {
+    const int bpp = image.pixelBytes();
+    const bool bgr = image.format == PIXEL_FORMAT_BGR || image.format == PIXEL_FORMAT_BGRA;
+    const int shifts[3] = {bgr ? 16 : 0, 8, bgr ? 0 : 16};
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 xmax = _mm256_set1_ps((float) (image.width - 1)), ymax = _mm256_set1_ps((float) (image.height - 1));
+    const __m256i xlast = _mm256_set1_epi32(image.width - 1), ylast = _mm256_set1_epi32(image.height - 1);
+    const __m256i stride = _mm256_set1_epi32(image.stride[0]), channels = _mm256_set1_epi32(bpp);
+    const __m256i ones = _mm256_set1_epi32(1), bytes = _mm256_set1_epi32(0xff);
+    const __m256i last = _mm256_set1_epi32((image.height - 1) * image.stride[0] + image.width * bpp - 4);
+    const int *src = (const int *) image.data[0];
+    int i = 0;
+    for (; i + 8 <= n; i += 8, dst += 24) {
+        __m256 pos = _mm256_add_ps(_mm256_set1_ps((float) i), lane);
+        __m256 sx = _mm256_add_ps(_mm256_set1_ps(x), _mm256_mul_ps(pos, _mm256_set1_ps(dx)));
+        __m256 sy = _mm256_add_ps(_mm256_set1_ps(y), _mm256_mul_ps(pos, _mm256_set1_ps(dy)));
+        sx = _mm256_min_ps(_mm256_max_ps(sx, _mm256_setzero_ps()), xmax);
+        sy = _mm256_min_ps(_mm256_max_ps(sy, _mm256_setzero_ps()), ymax);
+        __m256i x1 = _mm256_cvttps_epi32(sx), y1 = _mm256_cvttps_epi32(sy);
+        __m256 fx = _mm256_sub_ps(sx, _mm256_cvtepi32_ps(x1)), fy = _mm256_sub_ps(sy, _mm256_cvtepi32_ps(y1));
+        __m256i x2 = _mm256_min_epi32(_mm256_add_epi32(x1, ones), xlast);
+        __m256i y2 = _mm256_min_epi32(_mm256_add_epi32(y1, ones), ylast);
+        __m256i row1 = _mm256_mullo_epi32(y1, stride), row2 = _mm256_mullo_epi32(y2, stride);
+        __m256i col1 = _mm256_mullo_epi32(x1, channels), col2 = _mm256_mullo_epi32(x2, channels);
+        __m256i o22 = _mm256_add_epi32(row2, col2);
+        __m256i over = _mm256_cmpgt_epi32(o22, last);
+        if (!_mm256_testz_si256(over, over)) {
+            warpRowPacked(image, x + dx * i, y + dy * i, dx, dy, 8, dst);
+            continue;
+        }
+        __m256i p11 = _mm256_i32gather_epi32(src, _mm256_add_epi32(row1, col1), 1);
+        __m256i p12 = _mm256_i32gather_epi32(src, _mm256_add_epi32(row1, col2), 1);
+        __m256i p21 = _mm256_i32gather_epi32(src, _mm256_add_epi32(row2, col1), 1);
+        __m256i p22 = _mm256_i32gather_epi32(src, o22, 1);
+        __m256i result = _mm256_setzero_si256();
+        for (int c = 0; c < 3; c++) {
+            const __m128i shift = _mm_cvtsi32_si128(shifts[c]);
+            __m256 a = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p11, shift), bytes));
+            __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p12, shift), bytes));
+            __m256 top = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fx));
+            a = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p21, shift), bytes));
+            b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p22, shift), bytes));
+            __m256 bottom = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fx));
+            __m256 v = _mm256_add_ps(_mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy)),
+                                     _mm256_set1_ps(0.5f));
+            result = _mm256_or_si256(result, _mm256_slli_epi32(_mm256_cvttps_epi32(v), 8 * c));
+        }
+        uint32_t packed[8];
+        _mm256_storeu_si256((__m256i *) packed, result);
+        for (int k = 0; k < 8; k++)
+            memcpy(dst + k * 3, &packed[k], 3);
+    }
+    warpRowPacked(image, x + dx * i, y + dy * i, dx, dy, n - i, dst);
+}
+
+#endif
+
+static WarpRow selectPackedRow() {
+#if defined(PIXEL_AVX2)
+    if (pixelIsa() == PIXEL_ISA_AVX2)
+        return warpRowPackedAVX2;
+#endif
+    return warpRowPacked;
+}
+
+void warpFaces(const ImageView &image, const FaceTransform *transforms, int count, int size, unsigned char *out) {
+    if (count <= 0 || size <= 0 || out == NULL || !image.valid())
+        return;
+    static const WarpRow packedRow = selectPackedRow();
+    const bool yuv = image.format == PIXEL_FORMAT_NV12 || image.format == PIXEL_FORMAT_I420;
+    // the vector code uses 32 bit offsets
+    const bool large = (int64_t) image.stride[0] * image.height > INT32_MAX;
+    const WarpRow row = yuv ? warpRowYUV : (large ? warpRowPacked : packedRow);
+    const size_t row_bytes = (size_t) size * 3;
+#pragma omp parallel for schedule(static)
+    for (int job = 0; job < count * size; job++) {
+        const FaceTransform &t = transforms[job / size];
+        const float v = (float) (job % size);
+        row(image, t.tx - t.b * v, t.ty + t.a * v, t.a, t.b, size, out + (size_t) job * row_bytes);
+    }
+}
+
+void extractAlignedFaces(const ImageView &image, const std::vector<Bbox> &faces, int size, unsigned char *out) {
+    std::vector<FaceTransform> transforms(faces.size());
+    for (size_t i = 0; i < faces.size(); i++)
+        transforms[i] = solveFaceTransform(faces[i].ppoint, size);
+    warpFaces(image, transforms.data(), (int) transforms.size(), size, out);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef __MTCNN_FACE_ALIGN_H__
+#define __MTCNN_FACE_ALIGN_H__
+
+#include "mtcnn.h"
+#include "pixel_sampler.h"
+
+// Aligned face chips for recognition models: every face is mapped onto the
+// usual 112x112 five point template (eyes, nose tip, mouth corners, scaled
+// to the chip size) by the least squares similarity transform of its
+// landmarks. Only the chip pixels are sampled, the image is never rotated.
+
+#define ALIGNED_FACE_SIZE 112
+
+// chip (u, v) -> image (a * u - b * v + tx, b * u + a * v + ty)
+struct FaceTransform {
+    float a, b, tx, ty;
+};
+
+// landmarks are 5 x coordinates followed by 5 y coordinates, as in Bbox::ppoint
+FaceTransform solveFaceTransform(const float *landmarks, int size);
+
+// Bilinear warp of count size x size RGB chips into out, which holds
+// count * size * size * 3 bytes, chip after chip. Samples outside the image
+// repeat its border pixels. All chips are sampled in parallel, rows split
+// between the OpenMP threads.
+void warpFaces(const ImageView &image, const FaceTransform *transforms, int count, int size, unsigned char *out);
+
+void extractAlignedFaces(const ImageView &image, const std::vector<Bbox> &faces, int size, unsigned char *out);
+
+#endif //__MTCNN_FACE_ALIGN_H__
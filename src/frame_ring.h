@@ -0,0 +1,115 @@
+#pragma once
+
+#ifndef __MTCNN_FRAME_RING_H__
+#define __MTCNN_FRAME_RING_H__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Fixed set of preallocated frame buffers handed between one producer and one
+// consumer, frames are read in the order they were written. When all slots are
+// full the producer either waits or, with drop_oldest, reuses the oldest frame
+// the consumer has not started on yet, so a live source never falls behind.
+
+class FrameRing {
+public:
+    FrameRing(size_t slots, size_t frame_bytes)
+            : data(slots * frame_bytes), frameBytes(frame_bytes), state(slots, FREE), seq(slots, 0) {}
+
+    // slot to fill with the next frame, NULL after close()
+    unsigned char *acquireWrite(bool drop_oldest) {
+        std::unique_lock<std::mutex> lock(mutex);
+        int slot;
+        while (!closed && (slot = find(FREE)) < 0) {
+            if (drop_oldest && (slot = oldestFilled()) >= 0) {
+                dropCount++;
+                break;
+            }
+            changed.wait(lock);
+        }
+        if (closed)
+            return NULL;
+        state[slot] = WRITING;
+        return data.data() + slot * frameBytes;
+    }
+
+    // publishes the slot returned by the last acquireWrite() as frame number index
+    void commitWrite(int64_t index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int slot = find(WRITING);
+        state[slot] = FILLED;
+        seq[slot] = index;
+        changed.notify_all();
+    }
+
+    // oldest written frame, NULL once the ring is closed and drained
+    const unsigned char *acquireRead(int64_t &index) {
+        std::unique_lock<std::mutex> lock(mutex);
+        int slot;
+        while ((slot = oldestFilled()) < 0) {
+            if (closed)
+                return NULL;
+            changed.wait(lock);
+        }
+        state[slot] = READING;
+        index = seq[slot];
+        return data.data() + slot * frameBytes;
+    }
+
+    void releaseRead() {
+        std::lock_guard<std::mutex> lock(mutex);
+        state[find(READING)] = FREE;
+        changed.notify_all();
+    }
+
+    // no more frames: the producer stops, the consumer drains what is left
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        for (auto &s : state) {
+            if (s == WRITING)
+                s = FREE;
+        }
+        changed.notify_all();
+    }
+
+    size_t dropped() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropCount;
+    }
+
+private:
+    enum State {
+        FREE, WRITING, FILLED, READING
+    };
+
+    int find(State s) const {
+        for (size_t i = 0; i < state.size(); i++) {
+            if (state[i] == s)
+                return (int) i;
+        }
+        return -1;
+    }
+
+    int oldestFilled() const {
+        int oldest = -1;
+        for (size_t i = 0; i < state.size(); i++) {
+            if (state[i] == FILLED && (oldest < 0 || seq[i] < seq[oldest]))
+                oldest = (int) i;
+        }
+        return oldest;
+    }
+
+    std::vector<unsigned char> data;
+    const size_t frameBytes;
+    std::vector<State> state;
+    std::vector<int64_t> seq;
+    size_t dropCount = 0;
+    bool closed = false;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+};
+
+#endif //__MTCNN_FRAME_RING_H__
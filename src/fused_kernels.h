@@ -0,0 +1,123 @@
+#pragma once
+
+#ifndef __MTCNN_FUSED_KERNELS_H__
+#define __MTCNN_FUSED_KERNELS_H__
+
+#include "ncnn_model.h"
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+
+// Building blocks shared by the fused P/R/O-Net kernels. Feature maps are
+// channel-interleaved ([y][x][c]) and conv weights are packed [ky][kx][ic][oc]
+// so the innermost loop always runs over a compile-time number of output channels.
+
+static inline bool packConv(const ModelFile &model, const char *name, int ic, int oc, int kernel,
+                            float *w, float *b) {
+    const ModelLayer *layer = model.find(name);
+    if (layer == NULL || layer->type != "Convolution" || layer->storage == WEIGHT_INT8)
+        return false;
+    if (layer->numOutput() != oc || layer->getParam(1, 0) != kernel || layer->getParam(3, 1) != 1
+        || (int) layer->weight.size() != oc * ic * kernel * kernel || (int) layer->bias.size() != oc)
+        return false;
+    // ncnn [oc][ic][ky][kx] -> [ky][kx][ic][oc]
+    for (int o = 0; o < oc; o++) {
+        for (int i = 0; i < ic; i++) {
+            for (int k = 0; k < kernel * kernel; k++)
+                w[(k * ic + i) * oc + o] = layer->weight[(o * ic + i) * kernel * kernel + k];
+        }
+        b[o] = layer->bias[o];
+    }
+    return true;
+}
+
+static inline bool packPReLU(const ModelFile &model, const char *name, int channels, float *a) {
+    const ModelLayer *layer = model.find(name);
+    if (layer == NULL || layer->type != "PReLU" || (int) layer->slope.size() != channels)
+        return false;
+    memcpy(a, layer->slope.data(), channels * sizeof(float));
+    return true;
+}
+
+// one output row of a KxK valid convolution + PReLU, rows[] are the K input rows
+template<int IC, int OC, int K>
+static inline void convRow(const float *const *rows, int outw,
+                           const float *__restrict w, const float *__restrict b, const float *__restrict a,
+                           float *__restrict out) {
+    for (int x = 0; x < outw; x++) {
+        float acc[OC];
+        for (int o = 0; o < OC; o++)
+            acc[o] = b[o];
+        for (int ky = 0; ky < K; ky++) {
+            // the K pixels under the kernel are K * IC contiguous floats
+            const float *src = rows[ky] + x * IC;
+            const float *wk = w + ky * K * IC * OC;
+            for (int k = 0; k < K * IC; k++) {
+                const float v = src[k];
+                for (int o = 0; o < OC; o++)
+                    acc[o] += v * wk[k * OC + o];
+            }
+        }
+        for (int o = 0; o < OC; o++)
+            out[x * OC + o] = acc[o] < 0.f ? acc[o] * a[o] : acc[o];
+    }
+}
+
+// fixed-shape conv + PReLU + max pooling (ncnn full padding), PK == 1 disables pooling
+template<int IC, int OC, int K, int IH, int IW, int PK, int PS>
+struct ConvStage {
+    static const int CH = IH - K + 1, CW = IW - K + 1;
+    static const int OH = PK == 1 ? CH : (CH - PK + PS - 1) / PS + 1;
+    static const int OW = PK == 1 ? CW : (CW - PK + PS - 1) / PS + 1;
+    static const int IN_SIZE = IH * IW * IC;
+    static const int OUT_SIZE = OH * OW * OC;
+    static const int SCRATCH_SIZE = PK * CW * OC;
+
+    float w[K * K * IC * OC], b[OC], a[OC];
+
+    bool load(const ModelFile &model, const char *conv, const char *prelu) {
+        return packConv(model, conv, IC, OC, K, w, b) && packPReLU(model, prelu, OC, a);
+    }
+
+    void forward(const float *in, float *out, float *scratch) const {
+        const float *rows[K];
+        if (PK == 1) {
+            for (int y = 0; y < CH; y++) {
+                for (int k = 0; k < K; k++)
+                    rows[k] = in + (y + k) * IW * IC;
+                convRow<IC, OC, K>(rows, CW, w, b, a, out + y * CW * OC);
+            }
+            return;
+        }
+        // conv rows live in a PK slot ring, overlapping pooling windows reuse them
+        int next = 0;
+        for (int py = 0; py < OH; py++) {
+            const int r0 = py * PS;
+            const int r1 = std::min(r0 + PK, CH);
+            for (; next < r1; next++) {
+                for (int k = 0; k < K; k++)
+                    rows[k] = in + (next + k) * IW * IC;
+                convRow<IC, OC, K>(rows, CW, w, b, a, scratch + (next % PK) * CW * OC);
+            }
+            float *dst = out + py * OW * OC;
+            for (int px = 0; px < OW; px++) {
+                const int c0 = px * PS;
+                const int c1 = std::min(c0 + PK, CW);
+                float m[OC];
+                for (int o = 0; o < OC; o++)
+                    m[o] = -FLT_MAX;
+                for (int r = r0; r < r1; r++) {
+                    const float *src = scratch + (r % PK) * CW * OC;
+                    for (int c = c0; c < c1; c++) {
+                        for (int o = 0; o < OC; o++)
+                            m[o] = std::max(m[o], src[c * OC + o]);
+                    }
+                }
+                for (int o = 0; o < OC; o++)
+                    dst[px * OC + o] = m[o];
+            }
+        }
+    }
+};
+
+#endif //__MTCNN_FUSED_KERNELS_H__
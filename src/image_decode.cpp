@@ -0,0 +1,148 @@
+#include "image_decode.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+
+#ifdef MTCNN_WITH_LIBJPEG
+
+#include <setjmp.h>
+#include <jpeglib.h>
+
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void onJpegError(j_common_ptr cinfo) {
+    longjmp(((JpegError *) cinfo->err)->jump, 1);
+}
+
+static void onJpegMessage(j_common_ptr) {}
+
+static bool decodeJpeg(const unsigned char *data, size_t size, int denom, DecodedImage &image) {
+    jpeg_decompress_struct cinfo;
+    JpegError error;
+    unsigned char *volatile pixels = NULL;
+    cinfo.err = jpeg_std_error(&error.mgr);
+    error.mgr.error_exit = onJpegError;
+    error.mgr.output_message = onJpegMessage;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(pixels);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *) data, (unsigned long) size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    jpeg_start_decompress(&cinfo);
+    if (cinfo.output_components != 3) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    int width = cinfo.output_width, height = cinfo.output_height;
+    pixels = (unsigned char *) malloc((size_t) width * height * 3);
+    if (pixels == NULL) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels + (size_t) cinfo.output_scanline * width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    image.pixels = pixels;
+    image.width = width;
+    image.height = height;
+    image.full_width = cinfo.image_width;
+    image.full_height = cinfo.image_height;
+    image.denom = denom;
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+#endif
+
+// largest 1/denom that keeps a min_face face at MIN_DECODED_FACE pixels
+static int chooseDenom(int min_face) {
+    int denom = 1;
+    while (denom < 8 && min_face / (denom * 2) >= MIN_DECODED_FACE)
+        denom *= 2;
+    return denom;
+}
+
+bool decodeImageMemory(const unsigned char *data, size_t size, int min_face, DecodedImage &image) {
+    image = DecodedImage();
+    if (data == NULL || size == 0)
+        return false;
+#ifdef MTCNN_WITH_LIBJPEG
+    // full size decodes stay on stb, so their boxes match the other paths bit for bit
+    bool is_jpeg = size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+    const int denom = chooseDenom(min_face);
+    if (is_jpeg && denom > 1 && decodeJpeg(data, size, denom, image))
+        return true;
+#else
+    (void) min_face;
+#endif
+    int channels = 0;
+    image.pixels = stbi_load_from_memory(data, (int) size, &image.width, &image.height, &channels, 3);
+    if (image.pixels == NULL)
+        return false;
+    image.full_width = image.width;
+    image.full_height = image.height;
+    return true;
+}
+
+bool decodeImage(const char *filename, int min_face, DecodedImage &image) {
+    image = DecodedImage();
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    std::vector<unsigned char> data(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok && decodeImageMemory(data.data(), data.size(), min_face, image);
+}
+
+void freeImage(DecodedImage &image) {
+    // stb_image allocates with malloc as well
+    free(image.pixels);
+    image = DecodedImage();
+}
+
+int decodedMinFace(const DecodedImage &image, int min_face) {
+    if (image.full_width <= 0 || image.width == image.full_width)
+        return min_face;
+    int scaled = (int) ((float) min_face * image.width / image.full_width);
+    return scaled > 1 ? scaled : 1;
+}
+
+void mapFacesToFull(const DecodedImage &image, mtcnn_face *faces, int count) {
+    if (image.width <= 0 || image.height <= 0 || image.width == image.full_width)
+        return;
+    float sx = (float) image.full_width / image.width;
+    float sy = (float) image.full_height / image.height;
+    // a decoded pixel covers sx x sy full size pixels
+    for (int i = 0; i < count; i++) {
+        mtcnn_face &f = faces[i];
+        f.x1 = (int) lroundf(f.x1 * sx);
+        f.y1 = (int) lroundf(f.y1 * sy);
+        f.x2 = (int) lroundf((f.x2 + 1) * sx) - 1;
+        f.y2 = (int) lroundf((f.y2 + 1) * sy) - 1;
+        for (int k = 0; k < 5; k++) {
+            f.landmarks[k] = (f.landmarks[k] + 0.5f) * sx - 0.5f;
+            f.landmarks[k + 5] = (f.landmarks[k + 5] + 0.5f) * sy - 0.5f;
+        }
+    }
+}
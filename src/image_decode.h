@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef __MTCNN_IMAGE_DECODE_H__
+#define __MTCNN_IMAGE_DECODE_H__
+
+#include "mtcnn_c.h"
+#include <stddef.h>
+
+// Decoding to RGB888 at the lowest resolution the detector still needs.
+// JPEGs are scaled by 1/2, 1/4 or 1/8 inside the IDCT (libjpeg, when built
+// with MTCNN_WITH_LIBJPEG) as long as a min_face face keeps at least
+// MIN_DECODED_FACE pixels, everything else, full size JPEGs included, is
+// decoded by stb_image.
+
+// ONet looks at faces at 48x48, detail below that is not used
+#define MIN_DECODED_FACE 48
+
+struct DecodedImage {
+    unsigned char *pixels = NULL;
+    int width = 0, height = 0;
+    int full_width = 0, full_height = 0;
+    // 1, 2, 4 or 8
+    int denom = 1;
+};
+
+// min_face <= 0 always decodes at full size
+bool decodeImage(const char *filename, int min_face, DecodedImage &image);
+
+bool decodeImageMemory(const unsigned char *data, size_t size, int min_face, DecodedImage &image);
+
+void freeImage(DecodedImage &image);
+
+// min_face to detect with on the decoded image
+int decodedMinFace(const DecodedImage &image, int min_face);
+
+// maps faces found on the decoded image back to full size coordinates
+void mapFacesToFull(const DecodedImage &image, mtcnn_face *faces, int count);
+
+#endif //__MTCNN_IMAGE_DECODE_H__
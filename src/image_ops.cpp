@@ -0,0 +1,498 @@
+#include "image_ops.h"
+#include "pixel_convert.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+// Red eye kernels work on one row span staged as planar floats, padded with
+// zeros to a multiple of 8. Red pixels get their corrected value, the others
+// keep theirs, and the caller rounds on the way back.
+//
+// The reference is, per pixel:
+//   q = clamp(B / max(G, 1), 0.25, 2.25), redq = R / max(B + G, 1) * sqrt(q)
+//   if redq > 0.7: p = max(0, 1.525 - 0.75 * redq)^2,
+//                  R, G, B *= p, 0.75 + 0.25 * p, 0.5 + 0.5 * p
+// The vector kernels test redq > 0.7 without dividing, as
+//   25 * clamp(4B, G', 9G') * R^2 > 49 * max(B + G, 1)^2 * G'  with G' = max(G, 1),
+// and skip the rest of a vector when no lane passes. Only red pixels pay for
+// the reciprocals. The correction is the identity at redq = 0.7, so rounding
+// near the threshold moves a channel by less than 1.
+typedef void (*RedEyeKernel)(float *r, float *g, float *b, int n);
+
+static void redEyeScalar(float *r, float *g, float *b, int n) {
+    for (int i = 0; i < n; i++) {
+        float red = r[i], green = g[i], blue = b[i];
+        float nrv = std::max(blue + green, 1.f);
+        float bluf = green > 1 ? blue / green : blue;
+        bluf = std::max(0.5f, std::min(1.5f, sqrtf(bluf)));
+        float redq = red / nrv * bluf;
+        if (redq > 0.7f) {
+            float powr = std::max(0.f, 1.775f - (redq * 0.75f + 0.25f));
+            powr = powr * powr;
+            r[i] = powr * red;
+            g[i] = (0.75f + powr * 0.25f) * green;
+            b[i] = (0.5f + powr * 0.5f) * blue;
+        }
+    }
+}
+
+#if defined(PIXEL_X86)
+
+// one Newton step takes the 12 bit estimates to float precision
+TARGET_SSE2 static inline __m128 rcpSSE2(__m128 x) {
+    __m128 e = _mm_rcp_ps(x);
+    return _mm_mul_ps(e, _mm_sub_ps(_mm_set1_ps(2.f), _mm_mul_ps(x, e)));
+}
+
+TARGET_SSE2 static inline __m128 sqrtSSE2(__m128 x) {
+    __m128 e = _mm_rsqrt_ps(x);
+    e = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), e),
+                   _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_mul_ps(x, e), e)));
+    return _mm_mul_ps(x, e);
+}
+
+TARGET_SSE2 static inline __m128 blendSSE2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+TARGET_SSE2 static void redEyeSSE2(float *r, float *g, float *b, int n) {
+    const __m128 one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+    for (int i = 0; i < n; i += 4) {
+        __m128 red = _mm_loadu_ps(r + i), green = _mm_loadu_ps(g + i), blue = _mm_loadu_ps(b + i);
+        __m128 gd = _mm_max_ps(green, one);
+        __m128 nrv = _mm_max_ps(_mm_add_ps(blue, green), one);
+        __m128 q4 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(blue, _mm_set1_ps(4.f)), gd),
+                               _mm_mul_ps(gd, _mm_set1_ps(9.f)));
+        __m128 lhs = _mm_mul_ps(_mm_mul_ps(q4, _mm_set1_ps(25.f)), _mm_mul_ps(red, red));
+        __m128 rhs = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(nrv, nrv), _mm_set1_ps(49.f)), gd);
+        __m128 mask = _mm_cmpgt_ps(lhs, rhs);
+        if (_mm_movemask_ps(mask) == 0)
+            continue;
+        __m128 q = _mm_mul_ps(q4, rcpSSE2(_mm_mul_ps(gd, _mm_set1_ps(4.f))));
+        __m128 redq = _mm_mul_ps(_mm_mul_ps(red, sqrtSSE2(q)), rcpSSE2(nrv));
+        __m128 powr = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.525f), _mm_mul_ps(redq, _mm_set1_ps(0.75f))),
+                                 _mm_setzero_ps());
+        powr = _mm_mul_ps(powr, powr);
+        __m128 fg = _mm_add_ps(_mm_set1_ps(0.75f), _mm_mul_ps(powr, _mm_set1_ps(0.25f)));
+        __m128 fb = _mm_add_ps(half, _mm_mul_ps(powr, half));
+        _mm_storeu_ps(r + i, blendSSE2(mask, _mm_mul_ps(powr, red), red));
+        _mm_storeu_ps(g + i, blendSSE2(mask, _mm_mul_ps(fg, green), green));
+        _mm_storeu_ps(b + i, blendSSE2(mask, _mm_mul_ps(fb, blue), blue));
+    }
+}
+
+#if defined(PIXEL_AVX2)
+
+TARGET_AVX2 static inline __m256 rcpAVX2(__m256 x) {
+    __m256 e = _mm256_rcp_ps(x);
+    return _mm256_mul_ps(e, _mm256_sub_ps(_mm256_set1_ps(2.f), _mm256_mul_ps(x, e)));
+}
+
+TARGET_AVX2 static inline __m256 sqrtAVX2(__m256 x) {
+    __m256 e = _mm256_rsqrt_ps(x);
+    e = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), e),
+                      _mm256_sub_ps(_mm256_set1_ps(3.f), _mm256_mul_ps(_mm256_mul_ps(x, e), e)));
+    return _mm256_mul_ps(x, e);
+}
+
+TARGET_AVX2 static void redEyeAVX2(float *r, float *g, float *b, int n) {
+    const __m256 one = _mm256_set1_ps(1.f), half = _mm256_set1_ps(0.5f);
+    for (int i = 0; i < n; i += 8) {
+        __m256 red = _mm256_loadu_ps(r + i), green = _mm256_loadu_ps(g + i), blue = _mm256_loadu_ps(b + i);
+        __m256 gd = _mm256_max_ps(green, one);
+        __m256 nrv = _mm256_max_ps(_mm256_add_ps(blue, green), one);
+        __m256 q4 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(blue, _mm256_set1_ps(4.f)), gd),
+                                  _mm256_mul_ps(gd, _mm256_set1_ps(9.f)));
+        __m256 lhs = _mm256_mul_ps(_mm256_mul_ps(q4, _mm256_set1_ps(25.f)), _mm256_mul_ps(red, red));
+        __m256 rhs = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(nrv, nrv), _mm256_set1_ps(49.f)), gd);
+        __m256 mask = _mm256_cmp_ps(lhs, rhs, _CMP_GT_OQ);
+        if (_mm256_movemask_ps(mask) == 0)
+            continue;
+        __m256 q = _mm256_mul_ps(q4, rcpAVX2(_mm256_mul_ps(gd, _mm256_set1_ps(4.f))));
+        __m256 redq = _mm256_mul_ps(_mm256_mul_ps(red, sqrtAVX2(q)), rcpAVX2(nrv));
+        __m256 powr = _mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(1.525f),
+                                                  _mm256_mul_ps(redq, _mm256_set1_ps(0.75f))),
+                                    _mm256_setzero_ps());
+        powr = _mm256_mul_ps(powr, powr);
+        __m256 fg = _mm256_add_ps(_mm256_set1_ps(0.75f), _mm256_mul_ps(powr, _mm256_set1_ps(0.25f)));
+        __m256 fb = _mm256_add_ps(half, _mm256_mul_ps(powr, half));
+        _mm256_storeu_ps(r + i, _mm256_blendv_ps(red, _mm256_mul_ps(powr, red), mask));
+        _mm256_storeu_ps(g + i, _mm256_blendv_ps(green, _mm256_mul_ps(fg, green), mask));
+        _mm256_storeu_ps(b + i, _mm256_blendv_ps(blue, _mm256_mul_ps(fb, blue), mask));
+    }
+}
+
+#endif
+
+#elif defined(PIXEL_NEON)
+
+static inline float32x4_t rcpNEON(float32x4_t x) {
+    float32x4_t e = vrecpeq_f32(x);
+    return vmulq_f32(e, vrecpsq_f32(x, e));
+}
+
+static inline float32x4_t sqrtNEON(float32x4_t x) {
+    float32x4_t e = vrsqrteq_f32(x);
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+    return vmulq_f32(x, e);
+}
+
+static inline bool anyLaneNEON(uint32x4_t mask) {
+    uint32x2_t m = vorr_u32(vget_low_u32(mask), vget_high_u32(mask));
+    return (vget_lane_u32(m, 0) | vget_lane_u32(m, 1)) != 0;
+}
+
+static void redEyeNEON(float *r, float *g, float *b, int n) {
+    const float32x4_t one = vdupq_n_f32(1.f), half = vdupq_n_f32(0.5f);
+    for (int i = 0; i < n; i += 4) {
+        float32x4_t red = vld1q_f32(r + i), green = vld1q_f32(g + i), blue = vld1q_f32(b + i);
+        float32x4_t gd = vmaxq_f32(green, one);
+        float32x4_t nrv = vmaxq_f32(vaddq_f32(blue, green), one);
+        float32x4_t q4 = vminq_f32(vmaxq_f32(vmulq_n_f32(blue, 4.f), gd), vmulq_n_f32(gd, 9.f));
+        float32x4_t lhs = vmulq_f32(vmulq_n_f32(q4, 25.f), vmulq_f32(red, red));
+        float32x4_t rhs = vmulq_f32(vmulq_n_f32(vmulq_f32(nrv, nrv), 49.f), gd);
+        uint32x4_t mask = vcgtq_f32(lhs, rhs);
+        if (!anyLaneNEON(mask))
+            continue;
+        float32x4_t q = vmulq_f32(q4, rcpNEON(vmulq_n_f32(gd, 4.f)));
+        float32x4_t redq = vmulq_f32(vmulq_f32(red, sqrtNEON(q)), rcpNEON(nrv));
+        float32x4_t powr = vmaxq_f32(vsubq_f32(vdupq_n_f32(1.525f), vmulq_n_f32(redq, 0.75f)), vdupq_n_f32(0.f));
+        powr = vmulq_f32(powr, powr);
+        float32x4_t fg = vaddq_f32(vdupq_n_f32(0.75f), vmulq_n_f32(powr, 0.25f));
+        float32x4_t fb = vaddq_f32(half, vmulq_f32(powr, half));
+        vst1q_f32(r + i, vbslq_f32(mask, vmulq_f32(powr, red), red));
+        vst1q_f32(g + i, vbslq_f32(mask, vmulq_f32(fg, green), green));
+        vst1q_f32(b + i, vbslq_f32(mask, vmulq_f32(fb, blue), blue));
+    }
+}
+
+#endif
+
+// Rotation samples the source along a line per destination row span. The
+// coordinates are 16.16 fixed point, set exactly at the start of every span
+// and stepped by a constant per pixel after that (a 64 pixel span drifts by
+// less than 1/1000 pixel). Bilinear weights are 11 bit, the result is
+// truncated like the float version was. A source position x belongs to the
+// image for -1 < x < width, positions in (-1, 0) read column 0.
+struct RotateJob {
+    const unsigned char *src;
+    int srcWidth, srcHeight, srcStride;
+    unsigned char *dst;
+    int dstWidth, dstHeight, dstStride;
+    // packed fill pixel, alpha 255 for 4 channels
+    uint32_t fill;
+    double angleCos, angleSin;
+    double oldXradius, oldYradius, newXradius, newYradius;
+    int stepX, stepY;
+};
+
+// destination rows are split into bands of ROTATE_TILE rows, one band per
+// thread, and each band is walked in ROTATE_TILE wide tiles, so the source
+// pixels a tile reads stay in cache whatever the angle
+#define ROTATE_TILE 128
+
+#define ROTATE_FRACTION_BITS 11
+
+typedef void (*RotateBand)(const RotateJob &job, int y0, int y1);
+
+template<int C>
+static inline void storePixel(unsigned char *dst, uint32_t pixel) {
+    for (int c = 0; c < C; c++)
+        dst[c] = (unsigned char) (pixel >> (8 * c));
+}
+
+template<int C>
+static void rotateSpanScalar(const RotateJob &job, int X, int Y, int n, unsigned char *dst) {
+    const int xmax = job.srcWidth - 1, ymax = job.srcHeight - 1;
+    const int xlimit = job.srcWidth << 16, ylimit = job.srcHeight << 16;
+    const int one = 1 << ROTATE_FRACTION_BITS, shift = 16 - ROTATE_FRACTION_BITS;
+    for (int i = 0; i < n; i++, X += job.stepX, Y += job.stepY, dst += C) {
+        if (X <= -65536 || Y <= -65536 || X >= xlimit || Y >= ylimit) {
+            storePixel<C>(dst, job.fill);
+            continue;
+        }
+        const int xc = std::max(X, 0), yc = std::max(Y, 0);
+        const int x1 = xc >> 16, y1 = yc >> 16;
+        const int x2 = std::min(x1 + 1, xmax), y2 = std::min(y1 + 1, ymax);
+        const int fx = (xc & 0xffff) >> shift, fy = (yc & 0xffff) >> shift;
+        const unsigned char *p1 = job.src + (size_t) y1 * job.srcStride;
+        const unsigned char *p2 = job.src + (size_t) y2 * job.srcStride;
+        for (int c = 0; c < (C < 3 ? C : 3); c++) {
+            int top = p1[x1 * C + c] * (one - fx) + p1[x2 * C + c] * fx;
+            int bottom = p2[x1 * C + c] * (one - fx) + p2[x2 * C + c] * fx;
+            dst[c] = (unsigned char) ((top * (one - fy) + bottom * fy) >> (2 * ROTATE_FRACTION_BITS));
+        }
+        if (C == 4)
+            dst[3] = 255;
+    }
+}
+
+// the tile loops live in each kernel so a vector kernel is entered once per band
+template<int C, void (*Span)(const RotateJob &, int, int, int, unsigned char *)>
+static inline void rotateBand(const RotateJob &job, int y0, int y1) {
+    for (int x0 = 0; x0 < job.dstWidth; x0 += ROTATE_TILE) {
+        const int n = std::min(ROTATE_TILE, job.dstWidth - x0);
+        const double cx = x0 - job.newXradius;
+        for (int y = y0; y < y1; y++) {
+            const double cy = y - job.newYradius;
+            const int X = (int) floor((job.angleSin * cy + job.oldXradius + job.angleCos * cx) * 65536 + 0.5);
+            const int Y = (int) floor((job.angleCos * cy + job.oldYradius - job.angleSin * cx) * 65536 + 0.5);
+            Span(job, X, Y, n, job.dst + (size_t) y * job.dstStride + (size_t) x0 * C);
+        }
+    }
+}
+
+template<int C>
+static void rotateBandScalar(const RotateJob &job, int y0, int y1) {
+    rotateBand<C, rotateSpanScalar<C> >(job, y0, y1);
+}
+
+#if defined(PIXEL_AVX2)
+
+// 8 pixels per step, the four taps of each are fetched with one 32 bit
+// gather each. Vectors whose taps would read past the end of the image go
+// through the scalar code.
+template<int C>
+TARGET_AVX2 static void rotateSpanAVX2(const RotateJob &job, int X, int Y, int n, unsigned char *dst) {
+    const int one = 1 << ROTATE_FRACTION_BITS, shift = 16 - ROTATE_FRACTION_BITS;
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i low = _mm256_set1_epi32(-65536);
+    const __m256i xlimit = _mm256_set1_epi32(job.srcWidth << 16), ylimit = _mm256_set1_epi32(job.srcHeight << 16);
+    const __m256i xmax = _mm256_set1_epi32(job.srcWidth - 1), ymax = _mm256_set1_epi32(job.srcHeight - 1);
+    const __m256i stride = _mm256_set1_epi32(job.srcStride), channels = _mm256_set1_epi32(C);
+    const __m256i ones = _mm256_set1_epi32(1), weight = _mm256_set1_epi32(one);
+    const __m256i fraction = _mm256_set1_epi32(0xffff), bytes = _mm256_set1_epi32(0xff);
+    const __m256i fill = _mm256_set1_epi32((int) job.fill);
+    // last offset a 4 byte gather may start at
+    const __m256i last = _mm256_set1_epi32((job.srcHeight - 1) * job.srcStride + job.srcWidth * C - 4);
+    __m256i vx = _mm256_add_epi32(_mm256_set1_epi32(X), _mm256_mullo_epi32(lane, _mm256_set1_epi32(job.stepX)));
+    __m256i vy = _mm256_add_epi32(_mm256_set1_epi32(Y), _mm256_mullo_epi32(lane, _mm256_set1_epi32(job.stepY)));
+    const __m256i stepX = _mm256_set1_epi32(job.stepX * 8), stepY = _mm256_set1_epi32(job.stepY * 8);
+    const int *src = (const int *) job.src;
+    int i = 0;
+    for (; i + 8 <= n; i += 8, dst += 8 * C) {
+        __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(vx, low), _mm256_cmpgt_epi32(xlimit, vx)),
+                                          _mm256_and_si256(_mm256_cmpgt_epi32(vy, low), _mm256_cmpgt_epi32(ylimit, vy)));
+        __m256i pixels = fill;
+        if (!_mm256_testz_si256(inside, inside)) {
+            __m256i xc = _mm256_and_si256(_mm256_max_epi32(vx, _mm256_setzero_si256()), inside);
+            __m256i yc = _mm256_and_si256(_mm256_max_epi32(vy, _mm256_setzero_si256()), inside);
+            __m256i x1 = _mm256_srli_epi32(xc, 16), y1 = _mm256_srli_epi32(yc, 16);
+            __m256i x2 = _mm256_min_epi32(_mm256_add_epi32(x1, ones), xmax);
+            __m256i y2 = _mm256_min_epi32(_mm256_add_epi32(y1, ones), ymax);
+            __m256i fx = _mm256_srli_epi32(_mm256_and_si256(xc, fraction), shift);
+            __m256i fy = _mm256_srli_epi32(_mm256_and_si256(yc, fraction), shift);
+            __m256i row1 = _mm256_mullo_epi32(y1, stride), row2 = _mm256_mullo_epi32(y2, stride);
+            __m256i col1 = _mm256_mullo_epi32(x1, channels), col2 = _mm256_mullo_epi32(x2, channels);
+            __m256i o22 = _mm256_add_epi32(row2, col2);
+            if (!_mm256_testz_si256(_mm256_cmpgt_epi32(o22, last), _mm256_cmpgt_epi32(o22, last))) {
+                rotateSpanScalar<C>(job, _mm256_extract_epi32(vx, 0), _mm256_extract_epi32(vy, 0), 8, dst);
+                vx = _mm256_add_epi32(vx, stepX);
+                vy = _mm256_add_epi32(vy, stepY);
+                continue;
+            }
+            __m256i p11 = _mm256_i32gather_epi32(src, _mm256_add_epi32(row1, col1), 1);
+            __m256i p12 = _mm256_i32gather_epi32(src, _mm256_add_epi32(row1, col2), 1);
+            __m256i p21 = _mm256_i32gather_epi32(src, _mm256_add_epi32(row2, col1), 1);
+            __m256i p22 = _mm256_i32gather_epi32(src, o22, 1);
+            __m256i wx = _mm256_sub_epi32(weight, fx), wy = _mm256_sub_epi32(weight, fy);
+            __m256i result = C == 4 ? _mm256_set1_epi32((int) 0xff000000) : _mm256_setzero_si256();
+            for (int c = 0; c < (C < 3 ? C : 3); c++) {
+                __m256i a = _mm256_and_si256(_mm256_srli_epi32(p11, 8 * c), bytes);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(p12, 8 * c), bytes);
+                __m256i top = _mm256_add_epi32(_mm256_mullo_epi32(a, wx), _mm256_mullo_epi32(b, fx));
+                a = _mm256_and_si256(_mm256_srli_epi32(p21, 8 * c), bytes);
+                b = _mm256_and_si256(_mm256_srli_epi32(p22, 8 * c), bytes);
+                __m256i bottom = _mm256_add_epi32(_mm256_mullo_epi32(a, wx), _mm256_mullo_epi32(b, fx));
+                __m256i v = _mm256_add_epi32(_mm256_mullo_epi32(top, wy), _mm256_mullo_epi32(bottom, fy));
+                v = _mm256_srli_epi32(v, 2 * ROTATE_FRACTION_BITS);
+                result = _mm256_or_si256(result, _mm256_slli_epi32(v, 8 * c));
+            }
+            pixels = _mm256_blendv_epi8(fill, result, inside);
+        }
+        if (C == 4) {
+            _mm256_storeu_si256((__m256i *) dst, pixels);
+        } else {
+            uint32_t packed[8];
+            _mm256_storeu_si256((__m256i *) packed, pixels);
+            for (int k = 0; k < 8; k++)
+                storePixel<C>(dst + k * C, packed[k]);
+        }
+        vx = _mm256_add_epi32(vx, stepX);
+        vy = _mm256_add_epi32(vy, stepY);
+    }
+    rotateSpanScalar<C>(job, X + i * job.stepX, Y + i * job.stepY, n - i, dst);
+}
+
+template<int C>
+TARGET_AVX2 static void rotateBandAVX2(const RotateJob &job, int y0, int y1) {
+    rotateBand<C, rotateSpanAVX2<C> >(job, y0, y1);
+}
+
+#endif
+
+struct ImageOpsKernels {
+    const char *isa;
+    RedEyeKernel redEye;
+    // by channel count, 1, 3 and 4 are set
+    RotateBand rotate[5];
+};
+
+static ImageOpsKernels selectKernels() {
+    ImageOpsKernels kernels = {"scalar", redEyeScalar, {NULL, rotateBandScalar<1>, NULL, rotateBandScalar<3>,
+                                                         rotateBandScalar<4>}};
+    switch (pixelIsa()) {
+#if defined(PIXEL_AVX2)
+        case PIXEL_ISA_AVX2:
+            kernels.isa = "avx2";
+            kernels.redEye = redEyeAVX2;
+            kernels.rotate[1] = rotateBandAVX2<1>;
+            kernels.rotate[3] = rotateBandAVX2<3>;
+            kernels.rotate[4] = rotateBandAVX2<4>;
+            break;
+#endif
+#if defined(PIXEL_X86)
+        case PIXEL_ISA_SSE2:
+            kernels.isa = "sse2";
+            kernels.redEye = redEyeSSE2;
+            break;
+#elif defined(PIXEL_NEON)
+        case PIXEL_ISA_NEON:
+            kernels.isa = "neon";
+            kernels.redEye = redEyeNEON;
+            break;
+#endif
+        default:
+            break;
+    }
+    return kernels;
+}
+
+static const ImageOpsKernels &kernels() {
+    static const ImageOpsKernels selected = selectKernels();
+    return selected;
+}
+
+const char *imageOpsIsa() {
+    return kernels().isa;
+}
+
+static void removeRedEye(unsigned char *pixels, int width, int height, int channels, int stride,
+                         const EyeRegion &eye, RedEyeKernel kernel, std::vector<float> &span) {
+    const int radius = eye.radius;
+    const int top = std::max(eye.y - radius, 0), bottom = std::min(eye.y + radius, height);
+    const int padded = (2 * radius + 1 + 7) & ~7;
+    span.assign(padded * 3, 0.f);
+    float *r = span.data(), *g = r + padded, *b = g + padded;
+    for (int y = top; y < bottom; y++) {
+        // columns of the circle on this row, dx * dx + dy * dy <= radius * radius
+        const int dy = y - eye.y, rest = radius * radius - dy * dy;
+        int dx = (int) sqrtf((float) rest);
+        while (dx * dx > rest)
+            dx--;
+        while ((dx + 1) * (dx + 1) <= rest)
+            dx++;
+        const int left = std::max(eye.x - dx, 0), right = std::min(eye.x + dx + 1, std::min(eye.x + radius, width));
+        if (left >= right)
+            continue;
+        const int n = right - left;
+        unsigned char *p = pixels + (size_t) y * stride + (size_t) left * channels;
+        for (int i = 0; i < n; i++, p += channels) {
+            r[i] = p[0];
+            g[i] = p[1];
+            b[i] = p[2];
+        }
+        kernel(r, g, b, (n + 7) & ~7);
+        p = pixels + (size_t) y * stride + (size_t) left * channels;
+        for (int i = 0; i < n; i++, p += channels) {
+            p[0] = toByte(r[i]);
+            p[1] = toByte(g[i]);
+            p[2] = toByte(b[i]);
+        }
+    }
+}
+
+void removeRedEyes(unsigned char *pixels, int width, int height, int channels, int stride,
+                   const EyeRegion *eyes, int count) {
+    if (pixels == NULL || eyes == NULL || count <= 0 || width <= 0 || height <= 0 || channels < 3)
+        return;
+    if (stride <= 0)
+        stride = width * channels;
+    // eyes whose squares overlap share a group, groups are independent
+    std::vector<int> group(count);
+    for (int i = 0; i < count; i++) {
+        group[i] = i;
+        for (int j = 0; j < i; j++) {
+            const EyeRegion &a = eyes[i], &b = eyes[j];
+            if (abs(a.x - b.x) < a.radius + b.radius && abs(a.y - b.y) < a.radius + b.radius) {
+                int from = group[i], to = group[j];
+                for (int k = 0; k <= i; k++) {
+                    if (group[k] == from)
+                        group[k] = to;
+                }
+            }
+        }
+    }
+    std::vector<int> leaders;
+    for (int i = 0; i < count; i++) {
+        if (group[i] == i)
+            leaders.push_back(i);
+    }
+    const RedEyeKernel kernel = kernels().redEye;
+#pragma omp parallel for schedule(dynamic)
+    for (int l = 0; l < (int) leaders.size(); l++) {
+        std::vector<float> span;
+        for (int i = 0; i < count; i++) {
+            if (group[i] == leaders[l] && eyes[i].radius > 0)
+                removeRedEye(pixels, width, height, channels, stride, eyes[i], kernel, span);
+        }
+    }
+}
+
+bool rotateImage(const unsigned char *src, int srcWidth, int srcHeight, int srcStride, unsigned char *dst,
+                 int dstWidth, int dstHeight, int dstStride, int channels, float degree, const unsigned char *fill) {
+    if (src == NULL || dst == NULL || srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0)
+        return false;
+    if (channels != 1 && channels != 3 && channels != 4)
+        return false;
+    if (std::max(std::max(srcWidth, srcHeight), std::max(dstWidth, dstHeight)) > ROTATE_MAX_SIZE)
+        return false;
+    if (srcStride <= 0)
+        srcStride = srcWidth * channels;
+    if (dstStride <= 0)
+        dstStride = dstWidth * channels;
+    if ((int64_t) srcStride * srcHeight > INT32_MAX)
+        return false;
+    const unsigned char white[3] = {255, 255, 255};
+    if (fill == NULL)
+        fill = white;
+
+    const double angle = -degree * 3.14159265358979323846 / 180.0;
+    RotateJob job;
+    job.src = src;
+    job.srcWidth = srcWidth;
+    job.srcHeight = srcHeight;
+    job.srcStride = srcStride;
+    job.dst = dst;
+    job.dstWidth = dstWidth;
+    job.dstHeight = dstHeight;
+    job.dstStride = dstStride;
+    // gray images are filled with the green component
+    job.fill = channels == 1 ? fill[1] : fill[0] | fill[1] << 8 | fill[2] << 16 | 0xffu << 24;
+    job.angleCos = cos(angle);
+    job.angleSin = sin(angle);
+    job.oldXradius = (srcWidth - 1) / 2.0;
+    job.oldYradius = (srcHeight - 1) / 2.0;
+    job.newXradius = (dstWidth - 1) / 2.0;
+    job.newYradius = (dstHeight - 1) / 2.0;
+    job.stepX = (int) lround(job.angleCos * 65536);
+    job.stepY = (int) lround(-job.angleSin * 65536);
+    const RotateBand band = kernels().rotate[channels];
+    const int bands = (dstHeight + ROTATE_TILE - 1) / ROTATE_TILE;
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < bands; b++)
+        band(job, b * ROTATE_TILE, std::min((b + 1) * ROTATE_TILE, dstHeight));
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#ifndef __MTCNN_IMAGE_OPS_H__
+#define __MTCNN_IMAGE_OPS_H__
+
+// Post-processing on 8 bit images used by the demo. Red eye removal has
+// SSE2, AVX2 and NEON kernels, rotation an AVX2 one next to the portable
+// fixed point code; the kernels are picked once at runtime.
+
+struct EyeRegion {
+    int x, y;
+    int radius;
+};
+
+// Red eye removal inside the circles of all eyes, in place. Eyes that do not
+// overlap run in parallel, overlapping ones in the given order, so the result
+// is the same as processing them one after another. channels is 3 or 4,
+// stride 0 means width * channels.
+void removeRedEyes(unsigned char *pixels, int width, int height, int channels, int stride,
+                   const EyeRegion *eyes, int count);
+
+#define ROTATE_MAX_SIZE 16384
+
+// Bilinear rotation of src by degree around its center into the center of
+// dst. Pixels with no source get fill (RGB, white when NULL; gray images use
+// fill[1], alpha is 255). channels is 1, 3 or 4, stride 0 means tightly
+// packed rows. Returns false for bad arguments or images larger than
+// ROTATE_MAX_SIZE on a side.
+bool rotateImage(const unsigned char *src, int srcWidth, int srcHeight, int srcStride, unsigned char *dst,
+                 int dstWidth, int dstHeight, int dstStride, int channels, float degree,
+                 const unsigned char *fill = 0);
+
+// name of the instruction set the kernels use: "avx2", "sse2", "neon" or "scalar"
+const char *imageOpsIsa();
+
+#endif //__MTCNN_IMAGE_OPS_H__
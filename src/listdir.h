@@ -0,0 +1,121 @@
+#ifndef DEMO_LISTDIR_H
+#define DEMO_LISTDIR_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if _WIN32
+
+#include <windows.h>
+
+static bool isDirectory(const char *path) {
+    DWORD attr = GetFileAttributesA(path);
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+static void listDirectory(const char *path, std::vector<std::string> &files) {
+    WIN32_FIND_DATAA data;
+    std::string pattern = std::string(path) + "\\*";
+    HANDLE handle = FindFirstFileA(pattern.c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE)
+        return;
+    do {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            files.push_back(std::string(path) + "\\" + data.cFileName);
+    } while (FindNextFileA(handle, &data));
+    FindClose(handle);
+}
+
+#else
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+static bool isDirectory(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void listDirectory(const char *path, std::vector<std::string> &files) {
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string file = std::string(path) + "/" + entry->d_name;
+        if (!isDirectory(file.c_str()))
+            files.push_back(file);
+    }
+    closedir(dir);
+}
+
+#endif
+
+static bool isImageFile(const std::string &path) {
+    static const char *exts[] = {".jpg", ".jpeg", ".png", ".bmp", ".tga", ".ppm", ".pgm"};
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (const char *e : exts) {
+        if (ext == e)
+            return true;
+    }
+    return false;
+}
+
+static bool isListFile(const std::string &path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".txt" || ext == ".lst";
+}
+
+// one path per line, empty lines and lines starting with # are skipped
+static void readFileList(const char *path, std::vector<std::string> &files) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        size_t n = strlen(line);
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r' || line[n - 1] == ' '))
+            line[--n] = 0;
+        if (n > 0 && line[0] != '#')
+            files.push_back(line);
+    }
+    fclose(fp);
+}
+
+// expands a mix of image files, file lists and directories into an image list,
+// directories are sorted, file lists keep their order
+static std::vector<std::string> listImages(const std::vector<std::string> &paths) {
+    std::vector<std::string> images;
+    for (const auto &path : paths) {
+        if (isListFile(path)) {
+            readFileList(path.c_str(), images);
+        } else if (isDirectory(path.c_str())) {
+            std::vector<std::string> files;
+            listDirectory(path.c_str(), files);
+            std::sort(files.begin(), files.end());
+            for (const auto &file : files) {
+                if (isImageFile(file))
+                    images.push_back(file);
+            }
+        } else {
+            images.push_back(path);
+        }
+    }
+    return images;
+}
+
+#endif //DEMO_LISTDIR_H
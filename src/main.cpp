@@ -1,5 +1,17 @@
-#include "mtcnn.h"
+#include "mtcnn_c.h"
 #include "browse.h"
+#include "bounded_queue.h"
+#include "listdir.h"
+#include "image_decode.h"
+#include "result_writer.h"
+#include "image_ops.h"
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define USE_SHELL_OPEN
 #ifndef  nullptr
@@ -110,7 +122,7 @@ void getCurrentFilePath(const char *filePath, char *saveFile) {
 }
 
 void drawPoint(unsigned char *bits, int width, int depth, int x, int y, const uint8_t *color) {
-    for (int i = 0; i < min(depth, 3); ++i) {
+    for (int i = 0; i < std::min(depth, 3); ++i) {
         bits[(y * width + x) * depth + i] = color[i];
     }
 }
@@ -168,244 +180,6 @@ int Clamp(int Value, int Min, int Max) {
         return Value;
 }
 
-void
-RemoveRedEyes(unsigned char *input, unsigned char *output, int width, int height, int depth, int CenterX, int CenterY,
-              int Radius) {
-    if (depth < 3) return;
-    if ((input == nullptr) || (output == nullptr)) return;
-    if ((width <= 0) || (height <= 0)) return;
-
-    int Left = Clamp(CenterX - Radius, 0, width);
-    int Top = Clamp(CenterY - Radius, 0, height);
-    int Right = Clamp(CenterX + Radius, 0, width);
-    int Bottom = Clamp(CenterY + Radius, 0, height);
-    int PowRadius = Radius * Radius;
-
-    for (int Y = Top; Y < Bottom; Y++) {
-        unsigned char *in_scanline = input + Y * width * depth + Left * depth;
-        unsigned char *out_scanline = output + Y * width * depth + Left * depth;
-        int OffsetY = Y - CenterY;
-        for (int X = Left; X < Right; X++) {
-            int OffsetX = X - CenterX;
-            int dis = OffsetX * OffsetX + OffsetY * OffsetY;
-            if (dis <= PowRadius) {
-                float bluf = 0;
-                int Red = in_scanline[0];
-                int Green = in_scanline[1];
-                int Blue = in_scanline[2];
-                int nrv = Blue + Green;
-                if (nrv < 1) nrv = 1;
-                if (Green > 1)
-                    bluf = (float) Blue / Green;
-                else
-                    bluf = (float) Blue;
-                bluf = MAX(0.5f, MIN(1.5f, sqrt(bluf)));
-                float redq = (float) Red / nrv * bluf;
-                if (redq > 0.7f) {
-                    float powr = 1.775f - (redq * 0.75f +
-                                           0.25f);
-                    if (powr < 0) powr = 0;
-                    powr = powr * powr;
-                    float powb = 0.5f + powr * 0.5f;
-                    float powg = 0.75f + powr * 0.25f;
-                    out_scanline[0] = ClampToByte(powr * Red + 0.5f);
-                    out_scanline[1] = ClampToByte(powg * Green + 0.5f);
-                    out_scanline[2] = ClampToByte(powb * Blue + 0.5f);
-                }
-            }
-            in_scanline += depth;
-            out_scanline += depth;
-        }
-    }
-}
-
-void RotateBilinear(unsigned char *srcData, int srcWidth, int srcHeight, int Channels, int srcStride,
-                    unsigned char *dstData, int dstWidth, int dstHeight, int dstStride, float degree,
-                    int fillColorR = 255, int fillColorG = 255, int fillColorB = 255) {
-    if (srcData == NULL || dstData == NULL) return;
-
-    float oldXradius = (float) (srcWidth - 1) / 2;
-    float oldYradius = (float) (srcHeight - 1) / 2;
-
-    float newXradius = (float) (dstWidth - 1) / 2;
-    float newYradius = (float) (dstHeight - 1) / 2;
-
-    double MPI = 3.14159265358979323846;
-    double angleRad = -degree * MPI / 180.0;
-    float angleCos = (float) cos(angleRad);
-    float angleSin = (float) sin(angleRad);
-
-    int dstOffset = dstStride - ((Channels == 1) ? dstWidth : dstWidth * Channels);
-
-    unsigned char fillR = fillColorR;
-    unsigned char fillG = fillColorG;
-    unsigned char fillB = fillColorB;
-
-    unsigned char *src = srcData;
-    unsigned char *dst = dstData;
-
-    int ymax = srcHeight - 1;
-    int xmax = srcWidth - 1;
-    if (Channels == 1) {
-        float cy = -newYradius;
-        for (int y = 0; y < dstHeight; y++) {
-            float tx = angleSin * cy + oldXradius;
-            float ty = angleCos * cy + oldYradius;
-
-            float cx = -newXradius;
-            for (int x = 0; x < dstWidth; x++, dst++) {
-                float ox = tx + angleCos * cx;
-                float oy = ty - angleSin * cx;
-
-                int ox1 = (int) ox;
-                int oy1 = (int) oy;
-
-                if ((ox1 < 0) || (oy1 < 0) || (ox1 >= srcWidth) || (oy1 >= srcHeight)) {
-                    *dst = fillG;
-                } else {
-                    int ox2 = (ox1 == xmax) ? ox1 : ox1 + 1;
-                    int oy2 = (oy1 == ymax) ? oy1 : oy1 + 1;
-                    float dx1 = 0;
-                    if ((dx1 = ox - (float) ox1) < 0)
-                        dx1 = 0;
-                    float dx2 = 1.0f - dx1;
-                    float dy1 = 0;
-                    if ((dy1 = oy - (float) oy1) < 0)
-                        dy1 = 0;
-                    float dy2 = 1.0f - dy1;
-
-                    unsigned char *p1 = src + oy1 * srcStride;
-                    unsigned char *p2 = src + oy2 * srcStride;
-
-                    *dst = (unsigned char) (dy2 * (dx2 * p1[ox1] + dx1 * p1[ox2]) +
-                                            dy1 * (dx2 * p2[ox1] + dx1 * p2[ox2]));
-                }
-                cx++;
-            }
-            cy++;
-            dst += dstOffset;
-        }
-    } else if (Channels == 3) {
-        float cy = -newYradius;
-        for (int y = 0; y < dstHeight; y++) {
-            float tx = angleSin * cy + oldXradius;
-            float ty = angleCos * cy + oldYradius;
-
-            float cx = -newXradius;
-            for (int x = 0; x < dstWidth; x++, dst += Channels) {
-                float ox = tx + angleCos * cx;
-                float oy = ty - angleSin * cx;
-
-                int ox1 = (int) ox;
-                int oy1 = (int) oy;
-
-                if ((ox1 < 0) || (oy1 < 0) || (ox1 >= srcWidth) || (oy1 >= srcHeight)) {
-                    dst[0] = fillR;
-                    dst[1] = fillG;
-                    dst[2] = fillB;
-                } else {
-                    int ox2 = (ox1 == xmax) ? ox1 : ox1 + 1;
-                    int oy2 = (oy1 == ymax) ? oy1 : oy1 + 1;
-
-                    float dx1 = 0;
-                    if ((dx1 = ox - (float) ox1) < 0)
-                        dx1 = 0;
-                    float dx2 = 1.0f - dx1;
-                    float dy1 = 0;
-                    if ((dy1 = oy - (float) oy1) < 0)
-                        dy1 = 0;
-                    float dy2 = 1.0f - dy1;
-
-                    unsigned char *p1 = src + oy1 * srcStride;
-                    unsigned char *p2 = p1;
-                    p1 += ox1 * Channels;
-                    p2 += ox2 * Channels;
-
-                    unsigned char *p3 = src + oy2 * srcStride;
-                    unsigned char *p4 = p3;
-                    p3 += ox1 * Channels;
-                    p4 += ox2 * Channels;
-
-                    dst[0] = (unsigned char) (
-                            dy2 * (dx2 * p1[0] + dx1 * p2[0]) +
-                            dy1 * (dx2 * p3[0] + dx1 * p4[0]));
-
-                    dst[1] = (unsigned char) (
-                            dy2 * (dx2 * p1[1] + dx1 * p2[1]) +
-                            dy1 * (dx2 * p3[1] + dx1 * p4[1]));
-
-                    dst[2] = (unsigned char) (
-                            dy2 * (dx2 * p1[2] + dx1 * p2[2]) +
-                            dy1 * (dx2 * p3[2] + dx1 * p4[2]));
-                }
-                cx++;
-            }
-            cy++;
-            dst += dstOffset;
-        }
-    } else if (Channels == 4) {
-        float cy = -newYradius;
-        for (int y = 0; y < dstHeight; y++) {
-            float tx = angleSin * cy + oldXradius;
-            float ty = angleCos * cy + oldYradius;
-
-            float cx = -newXradius;
-            for (int x = 0; x < dstWidth; x++, dst += Channels) {
-                float ox = tx + angleCos * cx;
-                float oy = ty - angleSin * cx;
-
-                int ox1 = (int) ox;
-                int oy1 = (int) oy;
-
-                if ((ox1 < 0) || (oy1 < 0) || (ox1 >= srcWidth) || (oy1 >= srcHeight)) {
-                    dst[0] = fillR;
-                    dst[1] = fillG;
-                    dst[2] = fillB;
-                    dst[3] = 255;
-                } else {
-                    int ox2 = (ox1 == xmax) ? ox1 : ox1 + 1;
-                    int oy2 = (oy1 == ymax) ? oy1 : oy1 + 1;
-
-                    float dx1 = 0;
-                    if ((dx1 = ox - (float) ox1) < 0)
-                        dx1 = 0;
-                    float dx2 = 1.0f - dx1;
-                    float dy1 = 0;
-                    if ((dy1 = oy - (float) oy1) < 0)
-                        dy1 = 0;
-                    float dy2 = 1.0f - dy1;
-
-                    unsigned char *p1 = src + oy1 * srcStride;
-                    unsigned char *p2 = p1;
-                    p1 += ox1 * Channels;
-                    p2 += ox2 * Channels;
-
-                    unsigned char *p3 = src + oy2 * srcStride;
-                    unsigned char *p4 = p3;
-                    p3 += ox1 * Channels;
-                    p4 += ox2 * Channels;
-
-                    dst[0] = (unsigned char) (
-                            dy2 * (dx2 * p1[0] + dx1 * p2[0]) +
-                            dy1 * (dx2 * p3[0] + dx1 * p4[0]));
-
-                    dst[1] = (unsigned char) (
-                            dy2 * (dx2 * p1[1] + dx1 * p2[1]) +
-                            dy1 * (dx2 * p3[1] + dx1 * p4[1]));
-
-                    dst[2] = (unsigned char) (
-                            dy2 * (dx2 * p1[2] + dx1 * p2[2]) +
-                            dy1 * (dx2 * p3[2] + dx1 * p4[2]));
-                    dst[3] = 255;
-                }
-                cx++;
-            }
-            cy++;
-            dst += dstOffset;
-        }
-    }
-}
-
 void facialPoseCorrection(unsigned char *inputImage, int Width, int Height, int Channels, int left_eye_x,
                           int left_eye_y,
                           int right_eye_x, int right_eye_y) {
@@ -419,48 +193,381 @@ void facialPoseCorrection(unsigned char *inputImage, int Width, int Height, int
     size_t numberOfPixels = Width * Height * Channels * sizeof(unsigned char);
     unsigned char *outputImage = (unsigned char *) malloc(numberOfPixels);
     if (outputImage != nullptr) {
-        RotateBilinear(inputImage, Width, Height, Channels, Width * Channels, outputImage, Width, Height,
-                       Width * Channels, degree);
-        memcpy(inputImage, outputImage, numberOfPixels);
+        if (rotateImage(inputImage, Width, Height, 0, outputImage, Width, Height, 0, Channels, degree))
+            memcpy(inputImage, outputImage, numberOfPixels);
         free(outputImage);
     }
 }
 
+// Batch mode: decode, detect and encode run in their own thread pools
+// connected by bounded queues, so a slow stage never buffers more than
+// queue images. Results go to one file, see result_writer.h.
+struct BatchOptions {
+    std::string results = "results.jsonl";
+    ResultFormat format = RESULT_JSON;
+    // annotated images are written here when set
+    std::string annotate;
+    // aligned face chips are written here when set, see mtcnn_extract_aligned_faces
+    std::string chips;
+    int chip_size = MTCNN_ALIGNED_FACE_SIZE;
+    int decoders = 2;
+    int detectors = 2;
+    int encoders = 1;
+    int queue = 16;
+    int min_face = 40;
+    // OpenMP threads per detector, 0 splits the cores between the detectors
+    int threads = 0;
+    // pins every detector to its own range of threads CPUs
+    bool pin = false;
+    bool fast = false;
+    // decode JPEGs at full size even when min_face allows less
+    bool full_decode = false;
+};
+
+struct BatchItem {
+    size_t index = 0;
+    DecodedImage image;
+    double detect_ms = 0;
+    std::vector<mtcnn_face> faces;
+    const char *error = nullptr;
+};
+
+// "000012_photo" for the 13th input photo.jpg, inputs from different
+// directories may share a file name but never an index
+static std::string outputName(size_t index, const std::string &image) {
+    char fname[_MAX_FNAME];
+    splitpath(image.c_str(), nullptr, nullptr, fname, nullptr);
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%06zu_", index);
+    return prefix + std::string(fname);
+}
+
+static bool writeChips(const std::string &dir, const std::string &name, const DecodedImage &decoded,
+                       const std::vector<mtcnn_face> &faces, int size) {
+    if (faces.empty())
+        return true;
+    std::vector<unsigned char> chips(faces.size() * size * size * 3);
+    if (mtcnn_extract_aligned_faces(decoded.pixels, MTCNN_PIXEL_RGB, decoded.width, decoded.height, 0, faces.data(),
+                                    (int) faces.size(), size, chips.data()) < 0)
+        return false;
+    for (size_t i = 0; i < faces.size(); i++) {
+        std::string out = dir + "/" + name + "_face" + std::to_string(i) + ".jpg";
+        if (!stbi_write_jpg(out.c_str(), size, size, 3, chips.data() + i * size * size * 3, 95))
+            return false;
+    }
+    return true;
+}
+
+static void annotate(unsigned char *pixels, int width, const std::vector<mtcnn_face> &faces) {
+    const uint8_t red[3] = {255, 0, 0};
+    const uint8_t blue[3] = {0, 0, 255};
+    for (const auto &f : faces) {
+        drawRectangle(pixels, width, 3, f.x1, f.y1, f.x2, f.y2, red);
+        for (int num = 0; num < 5; num++)
+            drawPoint(pixels, width, 3, lround(f.landmarks[num]), lround(f.landmarks[num + 5]), blue);
+    }
+}
+
+// CPUs first .. first + count - 1, wrapped around the core count
+static std::string cpuRange(int first, int count, int cores) {
+    std::string list;
+    for (int i = 0; i < count; i++)
+        list += (i ? "," : "") + std::to_string((first + i) % cores);
+    return list;
+}
+
+static int runBatch(const char *model_path, const std::vector<std::string> &images, const BatchOptions &options) {
+    ResultWriter results;
+    if (!results.open(options.results.c_str(), options.format)) {
+        fprintf(stderr, "open %s failed.\n", options.results.c_str());
+        return -1;
+    }
+    const int cores = std::max(1, (int) std::thread::hardware_concurrency());
+    const int omp_threads = options.threads > 0 ? options.threads : std::max(1, cores / options.detectors);
+    std::vector<mtcnn_detector *> detectors;
+    for (int i = 0; i < options.detectors; i++) {
+        mtcnn_detector *detector = mtcnn_create(model_path);
+        if (detector == nullptr) {
+            fprintf(stderr, "load models from %s failed.\n", model_path);
+            for (auto d : detectors)
+                mtcnn_destroy(d);
+            return -1;
+        }
+        mtcnn_set_min_face(detector, options.min_face);
+        if (options.fast)
+            mtcnn_set_fast_path(detector, 1);
+        mtcnn_set_num_threads(detector, omp_threads);
+        if (options.pin && !mtcnn_set_cpu_affinity(detector, cpuRange(i * omp_threads, omp_threads, cores).c_str()))
+            fprintf(stderr, "pinning detector %d failed.\n", i);
+        detectors.push_back(detector);
+    }
+
+    BoundedQueue<BatchItem *> decoded(options.queue), detected(options.queue);
+    std::atomic<size_t> next(0);
+    std::atomic<int> decoders_left(options.decoders), detectors_left(options.detectors);
+    std::atomic<int> failed(0), faces_total(0);
+    std::vector<std::thread> threads;
+    double start = now();
+
+    for (int i = 0; i < options.decoders; i++) {
+        threads.emplace_back([&]() {
+            for (size_t index = next++; index < images.size(); index = next++) {
+                BatchItem *item = new BatchItem;
+                item->index = index;
+                // annotated images and face chips keep their full size
+                bool reduce = !options.full_decode && options.annotate.empty() && options.chips.empty();
+                if (!decodeImage(images[index].c_str(), reduce ? options.min_face : 0, item->image))
+                    item->error = "decode failed";
+                decoded.push(item);
+            }
+            if (--decoders_left == 0)
+                decoded.close();
+        });
+    }
+    for (int i = 0; i < options.detectors; i++) {
+        threads.emplace_back([&, i]() {
+            mtcnn_detector *detector = detectors[i];
+            BatchItem *item;
+            while (decoded.pop(item)) {
+                if (item->error == nullptr) {
+                    const DecodedImage &image = item->image;
+                    item->faces.resize(64);
+                    mtcnn_set_min_face(detector, decodedMinFace(image, options.min_face));
+                    double t0 = now();
+                    int found = mtcnn_detect_rgb(detector, image.pixels, image.width, image.height, 0,
+                                                 item->faces.data(), (int) item->faces.size());
+                    if (found > (int) item->faces.size()) {
+                        item->faces.resize(found);
+                        mtcnn_get_faces(detector, item->faces.data(), found);
+                    }
+                    item->detect_ms = calcElapsed(t0, now()) * 1000;
+                    item->faces.resize(std::max(found, 0));
+                    mapFacesToFull(image, item->faces.data(), (int) item->faces.size());
+                    if (found < 0)
+                        item->error = "detect failed";
+                }
+                detected.push(item);
+            }
+            if (--detectors_left == 0)
+                detected.close();
+        });
+    }
+    for (int i = 0; i < options.encoders; i++) {
+        threads.emplace_back([&]() {
+            BatchItem *item;
+            while (detected.pop(item)) {
+                const std::string &image = images[item->index];
+                const DecodedImage &decoded_image = item->image;
+                const std::string name = outputName(item->index, image);
+                if (item->error == nullptr && !options.chips.empty()
+                    && !writeChips(options.chips, name, decoded_image, item->faces, options.chip_size))
+                    item->error = "encode failed";
+                if (item->error == nullptr && !options.annotate.empty()) {
+                    annotate(decoded_image.pixels, decoded_image.width, item->faces);
+                    std::string out = options.annotate + "/" + name + "_done.jpg";
+                    if (!stbi_write_jpg(out.c_str(), decoded_image.width, decoded_image.height, 3,
+                                        decoded_image.pixels, 90))
+                        item->error = "encode failed";
+                }
+                ResultInfo info;
+                info.image = image.c_str();
+                info.index = (int64_t) item->index;
+                if (!options.annotate.empty() || !options.chips.empty())
+                    info.output = name.c_str();
+                info.width = decoded_image.full_width;
+                info.height = decoded_image.full_height;
+                info.detect_ms = item->detect_ms;
+                info.error = item->error;
+                results.write(info, item->faces.data(), (int) item->faces.size());
+                if (item->error)
+                    failed++;
+                else
+                    faces_total += (int) item->faces.size();
+                freeImage(item->image);
+                delete item;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    double elapsed = calcElapsed(start, now());
+    if (!results.close()) {
+        fprintf(stderr, "write %s failed.\n", options.results.c_str());
+        failed++;
+    }
+    mtcnn_pool_stats pools = {0, 0, 0, 0};
+    for (auto detector : detectors) {
+        mtcnn_pool_stats s;
+        if (mtcnn_get_pool_stats(detector, &s)) {
+            pools.requests += s.requests;
+            pools.hits += s.hits;
+            pools.cached_bytes += s.cached_bytes;
+        }
+        mtcnn_destroy(detector);
+    }
+    printf("%d images, %d faces, %d failed, %.2f s (%.2f images/s), results in %s\n", (int) images.size(),
+           faces_total.load(), failed.load(), elapsed, images.size() / std::max(elapsed, 1e-9),
+           options.results.c_str());
+    printf("buffer pools: %.1f%% of %zu allocations reused, %.1f MB cached\n",
+           100.0 * pools.hits / std::max<size_t>(pools.requests, 1), pools.requests, pools.cached_bytes / 1048576.0);
+    return failed ? 1 : 0;
+}
+
 int main(int argc, char **argv) {
     printf("mtcnn face detection\n");
     printf("blog:http://cpuimage.cnblogs.com/\n");
 
-    if (argc < 2) {
-        printf("usage: %s  model_path image_file \n ", argv[0]);
+    if (argc < 3) {
+        printf("usage: %s  model_path image_file [--trace trace.json] [--results file|-] [--format json|binary]\n ",
+               argv[0]);
+        printf("       %s  model_path --batch dir_or_list_or_image... [--results results.jsonl]\n"
+               "           [--format json|binary] [--annotate out_dir] [--chips out_dir] [--chip-size 112]\n"
+               "           [--decoders N] [--detectors N] [--encoders N] [--queue N] [--min-face N] [--fast]\n"
+               "           [--threads N] [--pin] [--full-decode]\n ",
+               argv[0]);
         printf("eg: %s  ../models ../sample.jpg \n ", argv[0]);
         printf("press any key to exit. \n");
         getchar();
         return 0;
     }
     const char *model_path = argv[1];
+    if (strcmp(argv[2], "--batch") == 0 || isDirectory(argv[2])) {
+        BatchOptions options;
+        std::vector<std::string> inputs;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--batch") {
+                continue;
+            } else if (arg == "--results" && has_value) {
+                options.results = argv[++i];
+            } else if (arg == "--format" && has_value) {
+                if (!parseResultFormat(argv[++i], options.format)) {
+                    fprintf(stderr, "unknown format %s.\n", argv[i]);
+                    return -1;
+                }
+            } else if (arg == "--annotate" && has_value) {
+                options.annotate = argv[++i];
+            } else if (arg == "--chips" && has_value) {
+                options.chips = argv[++i];
+            } else if (arg == "--chip-size" && has_value) {
+                options.chip_size = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--decoders" && has_value) {
+                options.decoders = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--detectors" && has_value) {
+                options.detectors = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--encoders" && has_value) {
+                options.encoders = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--queue" && has_value) {
+                options.queue = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--min-face" && has_value) {
+                options.min_face = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--threads" && has_value) {
+                options.threads = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--pin") {
+                options.pin = true;
+            } else if (arg == "--fast") {
+                options.fast = true;
+            } else if (arg == "--full-decode") {
+                options.full_decode = true;
+            } else {
+                inputs.push_back(arg);
+            }
+        }
+        std::vector<std::string> images = listImages(inputs);
+        if (images.empty()) {
+            fprintf(stderr, "no images found.\n");
+            return -1;
+        }
+        return runBatch(model_path, images, options);
+    }
     char *szfile = argv[2];
+    const char *trace_file = nullptr;
+    // with --results the faces are written out and the image is left alone
+    const char *results_file = nullptr;
+    ResultFormat results_format = RESULT_JSON;
+    for (int i = 3; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0)
+            trace_file = argv[++i];
+        else if (strcmp(argv[i], "--results") == 0)
+            results_file = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && !parseResultFormat(argv[++i], results_format)) {
+            fprintf(stderr, "unknown format %s.\n", argv[i]);
+            return -1;
+        }
+    }
+    mtcnn_trace_enable(trace_file != nullptr);
     getCurrentFilePath(szfile, saveFile);
     int Width = 0;
     int Height = 0;
     int Channels = 0;
     unsigned char *inputImage = loadImage(szfile, &Width, &Height, &Channels);
     if (inputImage == nullptr || Channels != 3) return -1;
-    ncnn::Mat ncnn_img = ncnn::Mat::from_pixels(inputImage, ncnn::Mat::PIXEL_RGB, Width, Height);
-    std::vector<Bbox> finalBbox;
-    MTCNN mtcnn(model_path);
+    mtcnn_detector *mtcnn = mtcnn_create(model_path);
+    if (mtcnn == nullptr) {
+        fprintf(stderr, "load models from %s failed.\n", model_path);
+        free(inputImage);
+        return -1;
+    }
     int miniFace = 40;
-    mtcnn.SetMinFace(miniFace);
+    mtcnn_set_min_face(mtcnn, miniFace);
+    mtcnn_enable_stats(mtcnn, 1);
+    std::vector<mtcnn_face> finalBbox(64);
     double startTime = now();
-    mtcnn.detect(ncnn_img, finalBbox);
+    int found = mtcnn_detect_rgb(mtcnn, inputImage, Width, Height, 0, finalBbox.data(), (int) finalBbox.size());
+    if (found > (int) finalBbox.size()) {
+        finalBbox.resize(found);
+        mtcnn_get_faces(mtcnn, finalBbox.data(), found);
+    }
+    finalBbox.resize(std::max(found, 0));
     double nDetectTime = calcElapsed(startTime, now());
+    if (trace_file != nullptr && !mtcnn_trace_write(trace_file))
+        fprintf(stderr, "write trace %s failed.\n", trace_file);
     printf("time: %d ms.\n ", (int) (nDetectTime * 1000));
+    mtcnn_stats stats;
+    mtcnn_pool_stats pools;
+    if (mtcnn_get_stats(mtcnn, &stats) && mtcnn_get_pool_stats(mtcnn, &pools))
+        printf("pnet: %d -> %d, rnet: %d -> %d, onet: %d -> %d, allocations: %zu (%zu from pools)\n",
+               stats.pnet_candidates, stats.pnet_kept, stats.rnet_candidates, stats.rnet_kept,
+               stats.onet_candidates, stats.onet_kept, stats.allocations, pools.hits);
+    mtcnn_destroy(mtcnn);
     size_t num_box = finalBbox.size();
     printf("face num: %d \n", (int) num_box);
+    if (results_file != nullptr) {
+        ResultWriter results;
+        ResultInfo info;
+        info.image = szfile;
+        info.index = 0;
+        info.width = Width;
+        info.height = Height;
+        info.detect_ms = nDetectTime * 1000;
+        if (found < 0)
+            info.error = "detect failed";
+        bool ok = results.open(results_file, results_format) && results.write(info, finalBbox.data(), (int) num_box)
+                  && results.close();
+        free(inputImage);
+        if (!ok)
+            fprintf(stderr, "write %s failed.\n", results_file);
+        return ok ? 0 : -1;
+    }
     bool draw_face_feat = true;
     int left_eye_x = 0;
     int left_eye_y = 0;
     int right_eye_x = 0;
     int right_eye_y = 0;
+    std::vector<EyeRegion> eyes;
+    for (int i = 0; i < num_box; i++) {
+        left_eye_x = lround(finalBbox[i].landmarks[0]);
+        left_eye_y = lround(finalBbox[i].landmarks[5]);
+        right_eye_x = lround(finalBbox[i].landmarks[1]);
+        right_eye_y = lround(finalBbox[i].landmarks[6]);
+        int dis_eye = (int) sqrtf((right_eye_x - left_eye_x) * (right_eye_x - left_eye_x) +
+                                  (right_eye_y - left_eye_y) * (right_eye_y - left_eye_y));
+        int radius = MAX(1, dis_eye / 9);
+        eyes.push_back({left_eye_x, left_eye_y, radius});
+        eyes.push_back({right_eye_x, right_eye_y, radius});
+    }
+    removeRedEyes(inputImage, Width, Height, Channels, 0, eyes.data(), (int) eyes.size());
     for (int i = 0; i < num_box; i++) {
         if (draw_face_feat) {
             const uint8_t red[3] = {255, 0, 0};
@@ -470,19 +577,10 @@ int main(int argc, char **argv) {
             const uint8_t blue[3] = {0, 0, 255};
 
             for (int num = 0; num < 5; num++) {
-                drawPoint(inputImage, Width, Channels, lround(finalBbox[i].ppoint[num]),
-                          lround(finalBbox[i].ppoint[num + 5]), blue);
+                drawPoint(inputImage, Width, Channels, lround(finalBbox[i].landmarks[num]),
+                          lround(finalBbox[i].landmarks[num + 5]), blue);
             }
         }
-        left_eye_x = lround(finalBbox[i].ppoint[0]);
-        left_eye_y = lround(finalBbox[i].ppoint[5]);
-        right_eye_x = lround(finalBbox[i].ppoint[1]);
-        right_eye_y = lround(finalBbox[i].ppoint[6]);
-        int dis_eye = (int) sqrtf((right_eye_x - left_eye_x) * (right_eye_x - left_eye_x) +
-                                  (right_eye_y - left_eye_y) * (right_eye_y - left_eye_y));
-        int radius = MAX(1, dis_eye / 9);
-        RemoveRedEyes(inputImage, inputImage, Width, Height, Channels, left_eye_x, left_eye_y, radius);
-        RemoveRedEyes(inputImage, inputImage, Width, Height, Channels, right_eye_x, right_eye_y, radius);
     }
     facialPoseCorrection(inputImage, Width, Height, Channels, left_eye_x, left_eye_y, right_eye_x, right_eye_y);
     saveImage("_done.jpg", Width, Height, Channels, inputImage);
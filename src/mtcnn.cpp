@@ -1,12 +1,32 @@
 
 
 #include "mtcnn.h"
+#include "pnet_fused.h"
+#include "ronet_fused.h"
+#include "trace.h"
+#include "thread_control.h"
+#include "cpu.h"
+#include <atomic>
+#include <chrono>
 
 
 bool cmpScore(Bbox lsh, Bbox rsh) {
     return lsh.score < rsh.score;
 }
 
+// R/O-Net candidates of warmup, two batches of the fused kernels
+static const int WARMUP_BOXES = 32;
+
+// bumped by every SetThreadOptions, so a thread knows whether its placement is current
+static std::atomic<int> placementGeneration(0);
+static thread_local int appliedPlacement = -1;
+// set while this thread carries the mask or memory policy of some detector
+static thread_local bool placedThread = false;
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
 
 MTCNN::MTCNN(const string &model_path) {
 
@@ -22,21 +42,15 @@ MTCNN::MTCNN(const string &model_path) {
             model_path + "/det3.bin"
     };
 
-    Pnet.load_param(param_files[0].data());
-    Pnet.load_model(bin_files[0].data());
-    Rnet.load_param(param_files[1].data());
-    Rnet.load_model(bin_files[1].data());
-    Onet.load_param(param_files[2].data());
-    Onet.load_model(bin_files[2].data());
+    paramFiles = param_files;
+    binFiles = bin_files;
+    loadNets();
 }
 
 MTCNN::MTCNN(const std::vector<std::string> param_files, const std::vector<std::string> bin_files) {
-    Pnet.load_param(param_files[0].data());
-    Pnet.load_model(bin_files[0].data());
-    Rnet.load_param(param_files[1].data());
-    Rnet.load_model(bin_files[1].data());
-    Onet.load_param(param_files[2].data());
-    Onet.load_model(bin_files[2].data());
+    paramFiles = param_files;
+    binFiles = bin_files;
+    loadNets();
 }
 
 
@@ -50,15 +64,248 @@ void MTCNN::SetMinFace(int minSize) {
     minsize = minSize;
 }
 
-void MTCNN::generateBbox(ncnn::Mat score, ncnn::Mat location, std::vector<Bbox> &boundingBox_, float scale) {
+void MTCNN::SetThreshold(float pnet, float rnet, float onet) {
+    threshold[0] = pnet;
+    threshold[1] = rnet;
+    threshold[2] = onet;
+}
+
+void MTCNN::SetScaleFactor(float factor) {
+    if (factor > 0.f && factor < 1.f && factor != pre_facetor) {
+        pre_facetor = factor;
+        plans.clear();
+    }
+}
+
+static float maxAbsDiff(const ncnn::Mat &a, const ncnn::Mat &b) {
+    if (a.w != b.w || a.h != b.h || a.c != b.c)
+        return INFINITY;
+    float diff = 0.f;
+    for (int q = 0; q < a.c; q++) {
+        const float *pa = a.channel(q);
+        const float *pb = b.channel(q);
+        for (int i = 0; i < a.w * a.h; i++)
+            diff = std::max(diff, fabsf(pa[i] - pb[i]));
+    }
+    return diff;
+}
+
+static ncnn::Mat randomInput(int w, int h, unsigned int seed) {
+    ncnn::Mat m(w, h, 3);
+    for (int q = 0; q < m.c; q++) {
+        float *p = m.channel(q);
+        for (int i = 0; i < w * h; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            p[i] = (seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+        }
+    }
+    return m;
+}
+
+// largest difference between batched kernel outputs and the ncnn graph on the same crops
+static float compareWithNet(const ncnn::Net &net, const std::vector<ncnn::Mat> &crops, const std::vector<float> &out,
+                            int out_dim, const std::vector<const char *> &blobs) {
+    float diff = 0.f;
+    for (size_t i = 0; i < crops.size(); i++) {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_light_mode(true);
+        ex.input("data", crops[i]);
+        int offset = 0;
+        for (const char *blob : blobs) {
+            ncnn::Mat m;
+            ex.extract(blob, m);
+            for (int j = 0; j < m.w && offset < out_dim; j++, offset++)
+                diff = std::max(diff, fabsf(m[j] - out[i * out_dim + offset]));
+        }
+        if (offset != out_dim)
+            return INFINITY;
+    }
+    return diff;
+}
+
+bool MTCNN::SetFusedPNet(bool enable) {
+    fusedPnet.reset();
+    if (!enable)
+        return true;
+    ModelFile model;
+    std::unique_ptr<FusedPNet> fused(new FusedPNet);
+    if (!model.load(paramFiles[0], binFiles[0]) || !fused->load(model))
+        return false;
+    // odd sizes exercise the pooling tails
+    ncnn::Mat probe = randomInput(67, 45, 12345);
+    ncnn::Mat score, location, ref_score, ref_location;
+    fused->forward(probe, score, location);
+    ncnn::Extractor ex = Pnet.create_extractor();
+    ex.set_light_mode(true);
+    ex.input("data", probe);
+    ex.extract("prob1", ref_score);
+    ex.extract("conv4-2", ref_location);
+    const float diff = std::max(maxAbsDiff(score, ref_score), maxAbsDiff(location, ref_location));
+    if (diff > 1e-3f) {
+        fprintf(stderr, "fused PNet disagrees with ncnn by %g, keeping ncnn\n", diff);
+        return false;
+    }
+    fusedPnet = std::move(fused);
+    return true;
+}
+
+bool MTCNN::SetFusedRONet(bool enable) {
+    fusedRnet.reset();
+    fusedOnet.reset();
+    if (!enable)
+        return true;
+    ModelFile rmodel, omodel;
+    std::unique_ptr<FusedRNet> rnet(new FusedRNet);
+    std::unique_ptr<FusedONet> onet(new FusedONet);
+    if (!rmodel.load(paramFiles[1], binFiles[1]) || !rnet->load(rmodel)
+        || !omodel.load(paramFiles[2], binFiles[2]) || !onet->load(omodel))
+        return false;
+    std::vector<ncnn::Mat> rcrops, ocrops;
+    for (unsigned int i = 0; i < 3; i++) {
+        rcrops.push_back(randomInput(FusedRNet::SIZE, FusedRNet::SIZE, 100 + i));
+        ocrops.push_back(randomInput(FusedONet::SIZE, FusedONet::SIZE, 200 + i));
+    }
+    std::vector<float> rout, oout;
+    rnet->forward(rcrops, rout);
+    onet->forward(ocrops, oout);
+    const float diff = std::max(compareWithNet(Rnet, rcrops, rout, FusedRNet::OUT_DIM, {"prob1", "conv5-2"}),
+                                compareWithNet(Onet, ocrops, oout, FusedONet::OUT_DIM,
+                                               {"prob1", "conv6-2", "conv6-3"}));
+    if (diff > 1e-3f) {
+        fprintf(stderr, "fused RNet/ONet disagree with ncnn by %g, keeping ncnn\n", diff);
+        return false;
+    }
+    fusedRnet = std::move(rnet);
+    fusedOnet = std::move(onet);
+    return true;
+}
+
+bool MTCNN::loadNets() {
+    Pnet.clear();
+    Rnet.clear();
+    Onet.clear();
+    ncnn::Net *nets[3] = {&Pnet, &Rnet, &Onet};
+    loaded = paramFiles.size() == 3 && binFiles.size() == 3;
+    for (int i = 0; loaded && i < 3; i++)
+        loaded = nets[i]->load_param(paramFiles[i].data()) == 0 && nets[i]->load_model(binFiles[i].data()) == 0;
+    return loaded;
+}
+
+void MTCNN::SetNumThreads(int threads) {
+    ThreadOptions options = threadOptions;
+    for (int &stage : options.threads)
+        stage = std::max(0, threads);
+    SetThreadOptions(options);
+}
+
+bool MTCNN::SetThreadOptions(const ThreadOptions &options) {
+    bool ok = true;
+    const bool moveWeights = options.numa_node != threadOptions.numa_node;
+    threadOptions = options;
+    for (int &stage : threadOptions.threads)
+        stage = std::max(0, stage);
+    placementCpus = threadOptions.cpus;
+    if (placementCpus.empty() && threadOptions.numa_node >= 0)
+        ok = numaNodeCpus(threadOptions.numa_node, placementCpus);
+    optionsGeneration = ++placementGeneration;
+    if (moveWeights) {
+        // the weights are written by this thread, so they land on its preferred
+        // node; the caller's own policy is put back afterwards
+        MemoryPolicy callerPolicy;
+        const bool savedPolicy = getThreadMemoryPolicy(callerPolicy);
+        if (threadOptions.numa_node >= 0 && !setThreadNumaNode(threadOptions.numa_node))
+            ok = false;
+        // cached scratch buffers belong to the old node
+        plans.clear();
+        blobPool.clear();
+        workspacePool.clear();
+        if (!loadNets())
+            ok = false;
+        if (fusedPnet && !SetFusedPNet(true))
+            ok = false;
+        if (fusedRnet && !SetFusedRONet(true))
+            ok = false;
+        if (savedPolicy)
+            setThreadMemoryPolicy(callerPolicy);
+        else
+            setThreadNumaNode(-1);
+    }
+    return ok;
+}
+
+void MTCNN::applyPlacement() {
+    if (appliedPlacement == optionsGeneration)
+        return;
+    appliedPlacement = optionsGeneration;
+    int team = 1;
+    for (int stage : threadOptions.threads)
+        team = std::max(team, stage > 0 ? stage : callerThreads);
+    if (placementCpus.empty() && threadOptions.numa_node < 0) {
+        // cleared options, or another detector without placement on this
+        // thread: undo what an earlier one left on the team
+#pragma omp parallel num_threads(team)
+        {
+            if (placedThread) {
+                restoreThreadPlacement();
+                placedThread = false;
+            }
+        }
+        return;
+    }
+    // OpenMP threads created later inherit the caller's mask and policy,
+    // the ones it already has are pinned by this region
+#pragma omp parallel num_threads(team)
+    {
+        // whatever this detector leaves unset is reset, not inherited from another one
+        if (placementCpus.empty())
+            restoreThreadPlacement();
+        else
+            setThreadAffinity(placementCpus);
+        setThreadNumaNode(threadOptions.numa_node);
+        placedThread = true;
+    }
+}
+
+void MTCNN::useStageThreads(int stage) {
+    const int threads = threadOptions.threads[stage];
+    ncnn::set_omp_num_threads(threads > 0 ? threads : callerThreads);
+}
+
+PoolStats MTCNN::GetPoolStats() const {
+    PoolStats blob = blobPool.stats(), workspace = workspacePool.stats();
+    blob.requests += workspace.requests;
+    blob.hits += workspace.hits;
+    blob.requested_bytes += workspace.requested_bytes;
+    blob.cached_bytes += workspace.cached_bytes;
+    return blob;
+}
+
+void MTCNN::SetPlanCacheSize(int count) {
+    maxPlans = (size_t) std::max(1, count);
+    while (plans.size() > maxPlans)
+        plans.pop_back();
+}
+
+void MTCNN::SetPyramidCanvas(bool enable) {
+    pyramidCanvas = enable;
+}
+
+void MTCNN::SetInputHook(std::function<void(int stage, const ncnn::Mat &in)> hook) {
+    inputHook = hook;
+}
+
+void MTCNN::generateBbox(ncnn::Mat score, ncnn::Mat location, std::vector<Bbox> &boundingBox_, float scale,
+                         int left, int top, int cols, int rows) {
     const int stride = 2;
     const int cellsize = 12;
-    //score p
-    float *p = score.channel(1);
+    if (cols < 0) cols = score.w - left;
+    if (rows < 0) rows = score.h - top;
     Bbox bbox = {0};
     float inv_scale = 1.0f / scale;
-    for (int row = 0; row < score.h; row++) {
-        for (int col = 0; col < score.w; col++) {
+    for (int row = 0; row < rows; row++) {
+        //score p
+        const float *p = score.channel(1).row(top + row) + left;
+        for (int col = 0; col < cols; col++) {
             if (*p > threshold[0]) {
                 bbox.score = *p;
                 bbox.x1 = lround((stride * col + 1) * inv_scale);
@@ -66,7 +313,7 @@ void MTCNN::generateBbox(ncnn::Mat score, ncnn::Mat location, std::vector<Bbox>
                 bbox.x2 = lround((stride * col + 1 + cellsize) * inv_scale);
                 bbox.y2 = lround((stride * row + 1 + cellsize) * inv_scale);
                 bbox.area = (bbox.x2 - bbox.x1) * (bbox.y2 - bbox.y1);
-                const int index = row * score.w + col;
+                const int index = (top + row) * score.w + left + col;
                 for (int channel = 0; channel < 4; channel++) {
                     bbox.regreCoord[channel] = location.channel(channel)[index];
                 }
@@ -81,6 +328,7 @@ void MTCNN::nms(std::vector<Bbox> &boundingBox_, const float overlap_threshold,
     if (boundingBox_.empty()) {
         return;
     }
+    TRACE_SCOPE("nms", "boxes", (int) boundingBox_.size());
     sort(boundingBox_.begin(), boundingBox_.end(), cmpScore);
     float IOU = 0;
     float maxX = 0;
@@ -135,7 +383,6 @@ void MTCNN::nms(std::vector<Bbox> &boundingBox_, const float overlap_threshold,
 
 void MTCNN::refine(std::vector<Bbox> &vecBbox, const int &height, const int &width, bool square) {
     if (vecBbox.empty()) {
-        cout << "Bbox is empty!!" << endl;
         return;
     }
     float bbw = 0, bbh = 0, maxSide = 0;
@@ -169,8 +416,7 @@ void MTCNN::refine(std::vector<Bbox> &vecBbox, const int &height, const int &wid
     }
 }
 
-void MTCNN::PNet() {
-    firstBbox.clear();
+std::vector<float> MTCNN::pyramidScales() const {
     float minl = img_w < img_h ? img_w : img_h;
     float m = (float) MIN_DET_SIZE / minsize;
     minl *= m;
@@ -181,34 +427,240 @@ void MTCNN::PNet() {
         minl *= factor;
         m = m * factor;
     }
-    for (float scale : scales) {
-        int hs = (int) ceil(img_h * scale);
-        int ws = (int) ceil(img_w * scale);
-        ncnn::Mat in;
-        resize_bilinear(img, in, ws, hs);
-        ncnn::Extractor ex = Pnet.create_extractor();
-        ex.set_light_mode(true);
-        ex.input("data", in);
-        ncnn::Mat score, location;
-        ex.extract("prob1", score);
-        ex.extract("conv4-2", location);
+    return scales;
+}
+
+void MTCNN::runPNet(const ncnn::Mat &in, ncnn::Mat &score, ncnn::Mat &location) {
+    if (inputHook) inputHook(0, in);
+    TRACE_SCOPE("pnet_extract", "w", in.w, "h", in.h);
+    if (fusedPnet) {
+        fusedPnet->forward(in, score, location, &blobPool);
+        return;
+    }
+    ncnn::Extractor ex = createExtractor(Pnet, 0);
+    ex.input("data", in);
+    ex.extract("prob1", score);
+    ex.extract("conv4-2", location);
+}
+
+MTCNN::PyramidPlan &MTCNN::pyramidPlan() {
+    for (auto it = plans.begin(); it != plans.end(); ++it) {
+        if (it->width == img_w && it->height == img_h && it->minsize == minsize) {
+            plans.splice(plans.begin(), plans, it);
+            return plans.front();
+        }
+    }
+    TRACE_SCOPE("pyramid_plan", "w", img_w, "h", img_h);
+    plans.emplace_front();
+    PyramidPlan &plan = plans.front();
+    plan.width = img_w;
+    plan.height = img_h;
+    plan.minsize = minsize;
+    std::vector<float> scales = pyramidScales();
+    if (!scales.empty())
+        plan.levels = packPyramid(scales, plan.canvas_w, plan.canvas_h);
+    plan.inputs.resize(plan.levels.size());
+    plan.scores.resize(plan.levels.size());
+    plan.locations.resize(plan.levels.size());
+    while (plans.size() > maxPlans)
+        plans.pop_back();
+    return plan;
+}
+
+// level k of the current input, in the plan's buffer when sampled from pixels
+ncnn::Mat MTCNN::levelInput(PyramidPlan &plan, size_t k) {
+    const PyramidLevel &level = plan.levels[k];
+    if (!fromPixels)
+        return sampleInput(0, 0, img_w, img_h, level.w, level.h);
+    if (plan.coeffs.empty()) {
+        plan.coeffs.resize(plan.levels.size());
+        for (size_t i = 0; i < plan.levels.size(); i++)
+            sampleCoeffs(0, 0, img_w, img_h, plan.levels[i].w, plan.levels[i].h, plan.coeffs[i]);
+    }
+    samplePixels(source, plan.coeffs[k], mean_vals[0], norm_vals[0], plan.inputs[k], &blobPool);
+    return plan.inputs[k];
+}
+
+void MTCNN::PNet() {
+    firstBbox.clear();
+    PyramidPlan &plan = pyramidPlan();
+    if (pyramidCanvas && plan.levels.size() > 1) {
+        PNetCanvas(plan);
+        return;
+    }
+    for (size_t i = 0; i < plan.levels.size(); i++) {
+        const PyramidLevel &level = plan.levels[i];
+        TRACE_SCOPE("pyramid_level", "level", (int) i);
+        ncnn::Mat in = levelInput(plan, i);
+        ncnn::Mat &score = plan.scores[i], &location = plan.locations[i];
+        runPNet(in, score, location);
         std::vector<Bbox> boundingBox;
-        generateBbox(score, location, boundingBox, scale);
+        generateBbox(score, location, boundingBox, level.scale);
+        if (stats) {
+            stats->pyramid.push_back(std::make_pair(level.w, level.h));
+            stats->pnet.candidates += (int) boundingBox.size();
+        }
         nms(boundingBox, nms_threshold[0]);
         firstBbox.insert(firstBbox.end(), boundingBox.begin(), boundingBox.end());
         boundingBox.clear();
     }
 }
 
+// shelf-packs the levels on even coordinates, the stride 2 grid of PNet then
+// lines up with every level and a 12x12 window inside a level sees exactly
+// the pixels it would see in a standalone run
+std::vector<MTCNN::PyramidLevel> MTCNN::packPyramid(const std::vector<float> &scales, int &canvas_w, int &canvas_h) const {
+    std::vector<PyramidLevel> levels;
+    for (float scale : scales) {
+        PyramidLevel level = {scale, 0, 0, (int) ceil(img_w * scale), (int) ceil(img_h * scale)};
+        levels.push_back(level);
+    }
+    canvas_w = levels[0].w + (levels.size() > 1 ? levels[1].w : 0);
+    canvas_w += canvas_w & 1;
+    canvas_h = 0;
+    struct Shelf {
+        int y, h, x;
+    };
+    std::vector<Shelf> shelves;
+    for (auto &level : levels) {
+        const int w = level.w + (level.w & 1);
+        const int h = level.h + (level.h & 1);
+        Shelf *shelf = NULL;
+        for (auto &s : shelves) {
+            if (s.x + w <= canvas_w && h <= s.h) {
+                shelf = &s;
+                break;
+            }
+        }
+        if (shelf == NULL) {
+            Shelf s = {canvas_h, h, 0};
+            shelves.push_back(s);
+            canvas_h += h;
+            shelf = &shelves.back();
+        }
+        level.x = shelf->x;
+        level.y = shelf->y;
+        shelf->x += w;
+    }
+    return levels;
+}
+
+void MTCNN::PNetCanvas(PyramidPlan &plan) {
+    const std::vector<PyramidLevel> &levels = plan.levels;
+    const int canvas_w = plan.canvas_w;
+    TRACE_SCOPE("pyramid_canvas", "levels", (int) levels.size());
+    ncnn::Mat &canvas = plan.canvas;
+    if (canvas.empty()) {
+        canvas.create(canvas_w, plan.canvas_h, 3, 4u, &blobPool);
+        canvas.fill(0.f);
+    }
+    for (size_t k = 0; k < levels.size(); k++) {
+        const PyramidLevel &level = levels[k];
+        if (stats)
+            stats->pyramid.push_back(std::make_pair(level.w, level.h));
+        const ncnn::Mat in = levelInput(plan, k);
+        // An odd level is padded to even size with a copy of its last column and
+        // row. ncnn pools in ceil mode, so standalone such a level ends in pooling
+        // windows cut by its edge; on the canvas those edge cells see the copy
+        // instead, every other cell sees exactly its standalone pixels.
+        const int pad_w = level.w & 1, pad_h = level.h & 1;
+        for (int q = 0; q < in.c; q++) {
+            const float *src = in.channel(q);
+            float *dst = (float *) canvas.channel(q) + level.y * canvas_w + level.x;
+            for (int y = 0; y < level.h; y++) {
+                float *row = dst + y * canvas_w;
+                memcpy(row, src + y * level.w, level.w * sizeof(float));
+                if (pad_w)
+                    row[level.w] = row[level.w - 1];
+            }
+            if (pad_h)
+                memcpy(dst + level.h * canvas_w, dst + (level.h - 1) * canvas_w, (level.w + pad_w) * sizeof(float));
+        }
+    }
+    ncnn::Mat &score = plan.scores[0], &location = plan.locations[0];
+    runPNet(canvas, score, location);
+    for (size_t k = 0; k < levels.size(); k++) {
+        const PyramidLevel &level = levels[k];
+        // score cells whose 12x12 window lies inside the padded level, the
+        // same cells a standalone run of the level produces
+        const int cols = (level.w + (level.w & 1) - 12) / 2 + 1;
+        const int rows = (level.h + (level.h & 1) - 12) / 2 + 1;
+        if (cols < 1 || rows < 1)
+            continue;
+        std::vector<Bbox> boundingBox;
+        generateBbox(score, location, boundingBox, level.scale, level.x / 2, level.y / 2, cols, rows);
+        if (stats)
+            stats->pnet.candidates += (int) boundingBox.size();
+        nms(boundingBox, nms_threshold[0]);
+        firstBbox.insert(firstBbox.end(), boundingBox.begin(), boundingBox.end());
+    }
+}
+
+ncnn::Mat MTCNN::sampleInput(int x, int y, int w, int h, int dst_w, int dst_h) {
+    ncnn::Mat in;
+    if (fromPixels) {
+        samplePixels(source, x, y, w, h, dst_w, dst_h, mean_vals[0], norm_vals[0], in, allocOption().blob_allocator);
+        return in;
+    }
+    if (x == 0 && y == 0 && w == img_w && h == img_h) {
+        resize_bilinear(img, in, dst_w, dst_h, allocOption());
+        return in;
+    }
+    ncnn::Mat tempIm;
+    copy_cut_border(img, tempIm, y, img_h - y - h, x, img_w - x - w, allocOption());
+    resize_bilinear(tempIm, in, dst_w, dst_h, allocOption());
+    return in;
+}
+
+ncnn::Mat MTCNN::cropInput(const Bbox &box, int size, int stage) {
+    ncnn::Mat in = sampleInput(box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1, size, size);
+    if (inputHook) inputHook(stage, in);
+    return in;
+}
+
+ncnn::Option MTCNN::allocOption() const {
+    ncnn::Option opt;
+    opt.blob_allocator = &blobPool;
+    opt.workspace_allocator = &workspacePool;
+    return opt;
+}
+
+ncnn::Extractor MTCNN::createExtractor(const ncnn::Net &net, int stage) const {
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_light_mode(true);
+    if (threadOptions.threads[stage] > 0)
+        ex.set_num_threads(threadOptions.threads[stage]);
+    ex.set_blob_allocator(&blobPool);
+    ex.set_workspace_allocator(&workspacePool);
+    return ex;
+}
+
 void MTCNN::RNet() {
+    TRACE_SCOPE("rnet", "boxes", (int) firstBbox.size());
     secondBbox.clear();
+    if (fusedRnet) {
+        std::vector<ncnn::Mat> crops;
+        for (auto &it : firstBbox)
+            crops.push_back(cropInput(it, FusedRNet::SIZE, 1));
+        std::vector<float> out;
+        fusedRnet->forward(crops, out);
+        for (size_t i = 0; i < firstBbox.size(); i++) {
+            const float *o = &out[i * FusedRNet::OUT_DIM];
+            if (o[1] > threshold[1]) {
+                Bbox it = firstBbox[i];
+                for (int channel = 0; channel < 4; channel++) {
+                    it.regreCoord[channel] = o[2 + channel];
+                }
+                it.area = (it.x2 - it.x1) * (it.y2 - it.y1);
+                it.score = o[1];
+                secondBbox.push_back(it);
+            }
+        }
+        return;
+    }
     for (auto &it : firstBbox) {
-        ncnn::Mat tempIm;
-        copy_cut_border(img, tempIm, it.y1, img_h - it.y2, it.x1, img_w - it.x2);
-        ncnn::Mat in;
-        resize_bilinear(tempIm, in, 24, 24);
-        ncnn::Extractor ex = Rnet.create_extractor();
-        ex.set_light_mode(true);
+        ncnn::Mat in = cropInput(it, 24, 1);
+        ncnn::Extractor ex = createExtractor(Rnet, 1);
         ex.input("data", in);
         ncnn::Mat score, bbox;
         ex.extract("prob1", score);
@@ -218,21 +670,42 @@ void MTCNN::RNet() {
                 it.regreCoord[channel] = (float) bbox[channel];
             }
             it.area = (it.x2 - it.x1) * (it.y2 - it.y1);
-            it.score = score.channel(1)[0];
+            it.score = score[1];
             secondBbox.push_back(it);
         }
     }
 }
 
 void MTCNN::ONet() {
+    TRACE_SCOPE("onet", "boxes", (int) secondBbox.size());
     thirdBbox.clear();
+    if (fusedOnet) {
+        std::vector<ncnn::Mat> crops;
+        for (auto &it : secondBbox)
+            crops.push_back(cropInput(it, FusedONet::SIZE, 2));
+        std::vector<float> out;
+        fusedOnet->forward(crops, out);
+        for (size_t i = 0; i < secondBbox.size(); i++) {
+            const float *o = &out[i * FusedONet::OUT_DIM];
+            if (o[1] > threshold[2]) {
+                Bbox it = secondBbox[i];
+                for (int channel = 0; channel < 4; channel++) {
+                    it.regreCoord[channel] = o[2 + channel];
+                }
+                it.area = (it.x2 - it.x1) * (it.y2 - it.y1);
+                it.score = o[1];
+                for (int num = 0; num < 5; num++) {
+                    (it.ppoint)[num] = it.x1 + (it.x2 - it.x1) * o[6 + num];
+                    (it.ppoint)[num + 5] = it.y1 + (it.y2 - it.y1) * o[6 + num + 5];
+                }
+                thirdBbox.push_back(it);
+            }
+        }
+        return;
+    }
     for (auto &it : secondBbox) {
-        ncnn::Mat tempIm;
-        copy_cut_border(img, tempIm, it.y1, img_h - it.y2, it.x1, img_w - it.x2);
-        ncnn::Mat in;
-        resize_bilinear(tempIm, in, 48, 48);
-        ncnn::Extractor ex = Onet.create_extractor();
-        ex.set_light_mode(true);
+        ncnn::Mat in = cropInput(it, 48, 2);
+        ncnn::Extractor ex = createExtractor(Onet, 2);
         ex.input("data", in);
         ncnn::Mat score, bbox, keyPoint;
         ex.extract("prob1", score);
@@ -243,7 +716,7 @@ void MTCNN::ONet() {
                 it.regreCoord[channel] = (float) bbox[channel];
             }
             it.area = (it.x2 - it.x1) * (it.y2 - it.y1);
-            it.score = score.channel(1)[0];
+            it.score = score[1];
             for (int num = 0; num < 5; num++) {
                 (it.ppoint)[num] = it.x1 + (it.x2 - it.x1) * keyPoint[num];
                 (it.ppoint)[num + 5] = it.y1 + (it.y2 - it.y1) * keyPoint[num + 5];
@@ -253,30 +726,228 @@ void MTCNN::ONet() {
     }
 }
 
-void MTCNN::detect(ncnn::Mat &img_, std::vector<Bbox> &finalBbox_) {
-    img = img_;
-    img_w = img.w;
-    img_h = img.h;
-    img.substract_mean_normalize(mean_vals, norm_vals);
+void MTCNN::cascade(std::vector<Bbox> &finalBbox_) {
+    finalBbox_.clear();
+    auto start = std::chrono::steady_clock::now();
+    useStageThreads(0);
     PNet();
     //the first stage's nms
-    if (firstBbox.empty()) return;
     nms(firstBbox, nms_threshold[0]);
     refine(firstBbox, img_h, img_w, true);
-    printf("firstBbox_.size()=%d\n", (int) firstBbox.size());
+    if (stats) {
+        stats->pnet.kept = (int) firstBbox.size();
+        stats->pnet.ms = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+    }
+    if (firstBbox.empty()) return;
     //second stage
+    useStageThreads(1);
     RNet();
-    printf("secondBbox_.size()=%d\n", (int) secondBbox.size());
-    if (secondBbox.empty())
-        return;
+    if (stats) stats->rnet.candidates = (int) secondBbox.size();
     nms(secondBbox, nms_threshold[1]);
     refine(secondBbox, img_h, img_w, true);
+    if (stats) {
+        stats->rnet.kept = (int) secondBbox.size();
+        stats->rnet.ms = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+    }
+    if (secondBbox.empty())
+        return;
     //third stage 
+    useStageThreads(2);
     ONet();
-    printf("thirdBbox_.size()=%d\n", (int) thirdBbox.size());
-    if (thirdBbox.empty())
-        return;
+    if (stats) stats->onet.candidates = (int) thirdBbox.size();
     refine(thirdBbox, img_h, img_w, true);
     nms(thirdBbox, nms_threshold[2], "Min");
+    if (stats) {
+        stats->onet.kept = (int) thirdBbox.size();
+        stats->onet.ms = elapsedMs(start);
+    }
+    if (thirdBbox.empty())
+        return;
     finalBbox_ = thirdBbox;
 }
+
+void MTCNN::detect(ncnn::Mat &img_, std::vector<Bbox> &finalBbox_, DetectStats *stats_) {
+    fromPixels = false;
+    img = img_;
+    img_w = img.w;
+    img_h = img.h;
+    img.substract_mean_normalize(mean_vals, norm_vals);
+    run(finalBbox_, stats_);
+}
+
+void MTCNN::detect(const ImageView &image, std::vector<Bbox> &finalBbox_, DetectStats *stats_) {
+    if (!image.valid()) {
+        finalBbox_.clear();
+        if (stats_)
+            *stats_ = DetectStats();
+        return;
+    }
+    source = image;
+    fromPixels = true;
+    img = ncnn::Mat();
+    img_w = image.width;
+    img_h = image.height;
+    run(finalBbox_, stats_);
+    fromPixels = false;
+}
+
+void MTCNN::detect(const unsigned char *pixels, PixelFormat format, int width, int height, int stride,
+                   std::vector<Bbox> &finalBbox_, DetectStats *stats_) {
+    detect(ImageView::fromPacked(pixels, format, width, height, stride), finalBbox_, stats_);
+}
+
+void MTCNN::detectNV12(const unsigned char *y, int y_stride, const unsigned char *uv, int uv_stride, int width,
+                       int height, std::vector<Bbox> &finalBbox_, DetectStats *stats_) {
+    detect(ImageView::fromNV12(y, y_stride, uv, uv_stride, width, height), finalBbox_, stats_);
+}
+
+void MTCNN::detectI420(const unsigned char *y, int y_stride, const unsigned char *u, int u_stride,
+                       const unsigned char *v, int v_stride, int width, int height, std::vector<Bbox> &finalBbox_,
+                       DetectStats *stats_) {
+    detect(ImageView::fromI420(y, y_stride, u, u_stride, v, v_stride, width, height), finalBbox_, stats_);
+}
+
+void MTCNN::warmup(int width, int height) {
+    if (width < MIN_DET_SIZE || height < MIN_DET_SIZE)
+        return;
+    TRACE_SCOPE("warmup", "w", width, "h", height);
+    // mid grey noise, the pixel values do not matter, only the sizes do
+    std::vector<unsigned char> pixels((size_t) width * height * 3);
+    unsigned int seed = 12345;
+    for (auto &p : pixels) {
+        seed = seed * 1664525u + 1013904223u;
+        p = (unsigned char) (64 + (seed >> 25));
+    }
+    const ImageView image = ImageView::fromPacked(pixels.data(), PIXEL_FORMAT_RGB, width, height);
+    std::function<void(int, const ncnn::Mat &)> hook;
+    hook.swap(inputHook);
+    std::vector<Bbox> faces;
+    detect(image, faces);
+
+    // noise rarely gets past PNet, so R/O-Net also run on fixed boxes from min face to the full image
+    source = image;
+    fromPixels = true;
+    img_w = width;
+    img_h = height;
+    callerThreads = ncnn::get_omp_num_threads();
+    const int side = std::min(width, height);
+    firstBbox.clear();
+    for (int i = 0; i < WARMUP_BOXES; i++) {
+        Bbox box = Bbox();
+        const int size = std::min(side, std::max(MIN_DET_SIZE, minsize + i * (side - minsize) / WARMUP_BOXES));
+        box.x1 = (width - size) * i / WARMUP_BOXES;
+        box.y1 = (height - size) * (WARMUP_BOXES - 1 - i) / WARMUP_BOXES;
+        box.x2 = box.x1 + size;
+        box.y2 = box.y1 + size;
+        firstBbox.push_back(box);
+    }
+    useStageThreads(1);
+    RNet();
+    secondBbox = firstBbox;
+    useStageThreads(2);
+    ONet();
+    ncnn::set_omp_num_threads(callerThreads);
+    firstBbox.clear();
+    secondBbox.clear();
+    thirdBbox.clear();
+    fromPixels = false;
+    inputHook.swap(hook);
+}
+
+void MTCNN::run(std::vector<Bbox> &finalBbox_, DetectStats *stats_) {
+    const auto start = std::chrono::steady_clock::now();
+    TRACE_SCOPE("detect", "w", img_w, "h", img_h);
+    stats = stats_;
+    PoolStats before = PoolStats();
+    if (stats) {
+        *stats = DetectStats();
+        before = GetPoolStats();
+    }
+    callerThreads = ncnn::get_omp_num_threads();
+    applyPlacement();
+    if (loaded)
+        cascade(finalBbox_);
+    else
+        finalBbox_.clear();
+    ncnn::set_omp_num_threads(callerThreads);
+    if (stats) {
+        const PoolStats after = GetPoolStats();
+        stats->total_ms = elapsedMs(start);
+        stats->allocations = after.requests - before.requests;
+        stats->allocated_bytes = after.requested_bytes - before.requested_bytes;
+        stats->pool_hits = after.hits - before.hits;
+        stats = NULL;
+    }
+}
+
+MTCNN::Stages::~Stages() {
+    m.fromPixels = false;
+}
+
+void MTCNN::Stages::setImage(const ImageView &image) {
+    m.source = image;
+    m.fromPixels = true;
+    m.img = ncnn::Mat();
+    m.img_w = image.width;
+    m.img_h = image.height;
+}
+
+void MTCNN::Stages::dropPlans() {
+    m.plans.clear();
+}
+
+size_t MTCNN::Stages::levels() {
+    return m.pyramidPlan().levels.size();
+}
+
+float MTCNN::Stages::levelScale(size_t k) {
+    return m.pyramidPlan().levels[k].scale;
+}
+
+ncnn::Mat MTCNN::Stages::levelInput(size_t k) {
+    return m.levelInput(m.pyramidPlan(), k);
+}
+
+void MTCNN::Stages::pnet(const ncnn::Mat &in, ncnn::Mat &score, ncnn::Mat &location) {
+    m.runPNet(in, score, location);
+}
+
+void MTCNN::Stages::generateBbox(const ncnn::Mat &score, const ncnn::Mat &location, float scale,
+                                 std::vector<Bbox> &boxes) {
+    m.generateBbox(score, location, boxes, scale);
+}
+
+void MTCNN::Stages::nms(std::vector<Bbox> &boxes, float threshold) {
+    m.nms(boxes, threshold);
+}
+
+void MTCNN::Stages::refine(std::vector<Bbox> &boxes) {
+    m.refine(boxes, m.img_h, m.img_w, true);
+}
+
+std::vector<Bbox> MTCNN::Stages::rnetInput() {
+    m.PNet();
+    m.nms(m.firstBbox, m.nms_threshold[0]);
+    m.refine(m.firstBbox, m.img_h, m.img_w, true);
+    return m.firstBbox;
+}
+
+std::vector<Bbox> MTCNN::Stages::onetInput(const std::vector<Bbox> &rnet_input) {
+    m.firstBbox = rnet_input;
+    m.RNet();
+    m.nms(m.secondBbox, m.nms_threshold[1]);
+    m.refine(m.secondBbox, m.img_h, m.img_w, true);
+    return m.secondBbox;
+}
+
+void MTCNN::Stages::rnet(const std::vector<Bbox> &input) {
+    m.firstBbox = input;
+    m.RNet();
+}
+
+void MTCNN::Stages::onet(const std::vector<Bbox> &input) {
+    m.secondBbox = input;
+    m.ONet();
+}
@@ -6,6 +6,8 @@
  
 
 #include "net.h"
+#include "pixel_sampler.h"
+#include "blob_pool.h"
 #include <math.h>
 #include <string>
 #include <vector>
@@ -13,8 +15,18 @@
 #include <algorithm>
 #include <map>
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <list>
 
 using namespace std;
+
+class FusedPNet;
+
+class FusedRNet;
+
+class FusedONet;
+
 struct Bbox {
     float score;
     int x1;
@@ -26,8 +38,39 @@ struct Bbox {
     float regreCoord[4];
 };
 
-class MTCNN {
+struct StageStats {
+    // wall time of the stage including its nms and refine
+    double ms;
+    // boxes passing the stage threshold, and left after the stage nms
+    int candidates;
+    int kept;
+};
+
+struct DetectStats {
+    StageStats pnet, rnet, onet;
+    double total_ms;
+    // width x height of every pyramid level fed to PNet
+    std::vector<std::pair<int, int> > pyramid;
+    // ncnn blob and workspace allocations made during the call, and the
+    // ones served from the detector's pools without touching the heap
+    size_t allocations;
+    size_t allocated_bytes;
+    size_t pool_hits;
+};
 
+// Parallelism of one detector. Several detectors in one process each get a
+// share of the cores instead of every one spawning a thread per core.
+struct ThreadOptions {
+    // OpenMP threads of the P/R/O-Net stages, 0 keeps the process default
+    int threads[3] = {0, 0, 0};
+    // CPUs the detecting thread and its OpenMP team are pinned to, empty for
+    // no pinning (or the CPUs of numa_node when that is set)
+    std::vector<int> cpus;
+    // NUMA node holding the weights and the scratch memory of detect, -1 for none
+    int numa_node = -1;
+};
+
+class MTCNN {
 public:
     MTCNN(const string &model_path);
 
@@ -35,36 +78,232 @@ public:
 
     ~MTCNN();
 
+    // false when a param or model file failed to load, detect finds nothing then
+    bool IsLoaded() const { return loaded; }
+
     void SetMinFace(int minSize);
 
-    void detect(ncnn::Mat &img_, std::vector<Bbox> &finalBbox);
+    // score thresholds of P/R/O-Net, defaults 0.8 0.8 0.6
+    void SetThreshold(float pnet, float rnet, float onet);
+
+    // scale step between pyramid levels, ignored unless 0 < factor < 1
+    void SetScaleFactor(float factor);
+
+    // stats, if given, is overwritten with timings and counts for this call
+    void detect(ncnn::Mat &img_, std::vector<Bbox> &finalBbox, DetectStats *stats = NULL);
+
+    // Reads the caller's pixels in place, the full frame is never copied or
+    // converted: only what the pyramid levels and the R/O-Net crops sample.
+    // Invalid views (see ImageView::valid) find no faces.
+    void detect(const ImageView &image, std::vector<Bbox> &finalBbox, DetectStats *stats = NULL);
+
+    // shorthands for the ImageView factories, stride 0 for tightly packed rows
+
+    // PIXEL_FORMAT_RGB, BGR, RGBA or BGRA
+    void detect(const unsigned char *pixels, PixelFormat format, int width, int height, int stride,
+                std::vector<Bbox> &finalBbox, DetectStats *stats = NULL);
+
+    void detectNV12(const unsigned char *y, int y_stride, const unsigned char *uv, int uv_stride, int width,
+                    int height, std::vector<Bbox> &finalBbox, DetectStats *stats = NULL);
+
+    void detectI420(const unsigned char *y, int y_stride, const unsigned char *u, int u_stride,
+                    const unsigned char *v, int v_stride, int width, int height, std::vector<Bbox> &finalBbox,
+                    DetectStats *stats = NULL);
+
+    // Runs the whole cascade once on a synthetic width x height image so the
+    // first real detect of that size does not pay for page faults, pool
+    // growth and per-thread scratch. Call it from the thread that will
+    // detect, after the options (min face, fast path, threads) are set.
+    void warmup(int width, int height);
+
+    // runs PNet through the fused kernel instead of the ncnn graph, returns false
+    // (and keeps the ncnn graph) if the kernel can not load det1 or disagrees with it
+    bool SetFusedPNet(bool enable);
+
+    // same as SetFusedPNet for the fixed-shape RNet and ONet kernels; with an
+    // fp16 model their hidden InnerProduct weights stay half precision in
+    // memory, the small output heads are always widened to fp32 (the ncnn
+    // graph widens all weights to fp32 at load)
+    bool SetFusedRONet(bool enable);
+
+    // packs all pyramid levels into one canvas and runs PNet once per image
+    void SetPyramidCanvas(bool enable);
+
+    // pyramid plans kept for the most recently seen (width, height, min face)
+    // combinations, default 4, at least 1
+    void SetPlanCacheSize(int plans);
+
+    // same thread count for all three stages
+    void SetNumThreads(int threads);
+
+    // Takes effect on the next detect call, which pins the calling thread and
+    // its OpenMP team; they keep the mask and memory policy after it returns.
+    // Cleared options, or a detector without them running on the same thread,
+    // restore the process mask from startup and the default policy. A new
+    // numa_node reloads the weights on that node right away, the calling
+    // thread gets its own memory policy back afterwards. Returns false if the
+    // CPUs or the node can not be used on this system, or the reload or the
+    // fused kernels fail; options are kept anyway.
+    bool SetThreadOptions(const ThreadOptions &options);
+
+    const ThreadOptions &GetThreadOptions() const { return threadOptions; }
+
+    // blob and workspace pool totals of all detect calls so far
+    PoolStats GetPoolStats() const;
+
+    // called with every network input, stage 0/1/2 for P/R/O-Net; pyramid
+    // levels are reused by the next call of the same size, clone to keep them
+    void SetInputHook(std::function<void(int stage, const ncnn::Mat &in)> hook);
+
+    // Single cascade stages for tools/mtcnn_bench.cpp, not part of the detection
+    // API: no placement, stats or per-stage threads. The view set by setImage
+    // must outlive its use.
+    class Stages {
+    public:
+        explicit Stages(MTCNN &detector) : m(detector) {}
+
+        ~Stages();
+
+        void setImage(const ImageView &image);
+
+        // drops the cached pyramid plans, the next level call rebuilds them
+        void dropPlans();
+
+        // levels of the plan for the current image and min face
+        size_t levels();
+
+        float levelScale(size_t k);
+
+        // level k sampled from the view with the plan's coefficients
+        ncnn::Mat levelInput(size_t k);
+
+        void pnet(const ncnn::Mat &in, ncnn::Mat &score, ncnn::Mat &location);
+
+        void generateBbox(const ncnn::Mat &score, const ncnn::Mat &location, float scale, std::vector<Bbox> &boxes);
+
+        void nms(std::vector<Bbox> &boxes, float threshold);
+
+        void refine(std::vector<Bbox> &boxes);
+
+        // runs the cascade up to the RNet input, then up to the ONet input
+        std::vector<Bbox> rnetInput();
+
+        std::vector<Bbox> onetInput(const std::vector<Bbox> &rnet_input);
+
+        void rnet(const std::vector<Bbox> &input);
+
+        void onet(const std::vector<Bbox> &input);
+
+    private:
+        MTCNN &m;
+    };
 
 private:
-    void generateBbox(ncnn::Mat score, ncnn::Mat location, vector<Bbox> &boundingBox_, float scale);
+    struct PyramidLevel {
+        float scale;
+        int x, y, w, h;
+    };
+
+    // What PNet sets up for one input size: the levels, their canvas layout,
+    // the sampler coefficients and the level buffers. A stream of same sized
+    // frames builds it once.
+    struct PyramidPlan {
+        int width, height, minsize;
+        // x, y place the level on the canvas
+        std::vector<PyramidLevel> levels;
+        int canvas_w = 0, canvas_h = 0;
+        // filled on first use, the canvas keeps its zero padding between frames
+        ncnn::Mat canvas;
+        std::vector<SampleCoeffs> coeffs;
+        std::vector<ncnn::Mat> inputs, scores, locations;
+    };
+
+    // left/top/cols/rows select the score cells of one level on a packed canvas,
+    // the defaults take the whole score map
+    void generateBbox(ncnn::Mat score, ncnn::Mat location, vector<Bbox> &boundingBox_, float scale,
+                      int left = 0, int top = 0, int cols = -1, int rows = -1);
 
     void nms(vector<Bbox> &boundingBox_, const float overlap_threshold, string modelname = "Union");
 
     void refine(vector<Bbox> &vecBbox, const int &height, const int &width, bool square);
 
+    std::vector<float> pyramidScales() const;
+
+    std::vector<PyramidLevel> packPyramid(const std::vector<float> &scales, int &canvas_w, int &canvas_h) const;
+
+    void runPNet(const ncnn::Mat &in, ncnn::Mat &score, ncnn::Mat &location);
+
     void PNet();
 
+    PyramidPlan &pyramidPlan();
+
+    ncnn::Mat levelInput(PyramidPlan &plan, size_t k);
+
+    void PNetCanvas(PyramidPlan &plan);
+
     void RNet();
 
     void ONet();
 
+    // bilinear resize of the rect x, y, w, h of the input to dst_w x dst_h
+    ncnn::Mat sampleInput(int x, int y, int w, int h, int dst_w, int dst_h);
+
+    ncnn::Mat cropInput(const Bbox &box, int size, int stage);
+
+    ncnn::Extractor createExtractor(const ncnn::Net &net, int stage) const;
+
+    bool loadNets();
+
+    // pins the calling thread and its OpenMP team once per thread and options change
+    void applyPlacement();
+
+    // OpenMP thread count for the kernels of a stage
+    void useStageThreads(int stage);
+
+    ncnn::Option allocOption() const;
+
+    void cascade(std::vector<Bbox> &finalBbox);
+
+    void run(std::vector<Bbox> &finalBbox, DetectStats *stats);
+
     ncnn::Net Pnet, Rnet, Onet;
+    std::vector<std::string> paramFiles, binFiles;
+    bool loaded = false;
+    std::unique_ptr<FusedPNet> fusedPnet;
+    std::unique_ptr<FusedRNet> fusedRnet;
+    std::unique_ptr<FusedONet> fusedOnet;
     ncnn::Mat img;
+    // input pixels of the current detect call when fromPixels is set, img is unused then
+    ImageView source;
+    bool fromPixels = false;
     const float nms_threshold[3] = {0.5f, 0.7f, 0.7f};
     const float mean_vals[3] = {127.5, 127.5, 127.5};
     const float norm_vals[3] = {0.0078125, 0.0078125, 0.0078125};
     const int MIN_DET_SIZE = 12;
     std::vector<Bbox> firstBbox, secondBbox, thirdBbox;
     int img_w, img_h;
+    std::function<void(int, const ncnn::Mat &)> inputHook;
+    // every extractor draws from these, a detector is driven by one thread at a
+    // time so blobs need no lock; workspace is also used by the OpenMP team
+    mutable BlobPool blobPool{false};
+    mutable BlobPool workspacePool{true};
+    // most recently used first, after the pools so its Mats go first
+    std::list<PyramidPlan> plans;
+    size_t maxPlans = 4;
+    // set for the duration of a detect() call that requested stats
+    DetectStats *stats = NULL;
 
 private:
-    const float threshold[3] = {0.8f, 0.8f, 0.6f};
+    float threshold[3] = {0.8f, 0.8f, 0.6f};
     int minsize = 40;
-    const float pre_facetor = 0.709f;
+    bool pyramidCanvas = false;
+    float pre_facetor = 0.709f;
+    ThreadOptions threadOptions;
+    // threadOptions.cpus, or the CPUs of the NUMA node
+    std::vector<int> placementCpus;
+    int optionsGeneration = 0;
+    // OpenMP thread count of the caller, restored after run
+    int callerThreads = 0;
 
 };
 
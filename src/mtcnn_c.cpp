@@ -0,0 +1,252 @@
+#include "mtcnn_c.h"
+#include "mtcnn.h"
+#include "face_align.h"
+#include "thread_control.h"
+#include "trace.h"
+#include <stdio.h>
+
+struct mtcnn_detector {
+    explicit mtcnn_detector(const std::string &model_path) : mtcnn(model_path) {}
+
+    MTCNN mtcnn;
+    bool stats_enabled = false;
+    bool stats_valid = false;
+    DetectStats stats;
+    std::vector<Bbox> faces;
+};
+
+static bool modelsExist(const std::string &model_path) {
+    static const char *const files[] = {"det1.param", "det1.bin", "det2.param", "det2.bin", "det3.param", "det3.bin"};
+    for (const char *file : files) {
+        FILE *fp = fopen((model_path + "/" + file).c_str(), "rb");
+        if (fp == NULL)
+            return false;
+        fclose(fp);
+    }
+    return true;
+}
+
+int mtcnn_api_version(void) {
+    return MTCNN_API_VERSION;
+}
+
+mtcnn_detector *mtcnn_create(const char *model_path) {
+    if (model_path == NULL || !modelsExist(model_path))
+        return NULL;
+    try {
+        mtcnn_detector *detector = new mtcnn_detector(model_path);
+        if (!detector->mtcnn.IsLoaded()) {
+            delete detector;
+            return NULL;
+        }
+        return detector;
+    } catch (...) {
+        return NULL;
+    }
+}
+
+void mtcnn_destroy(mtcnn_detector *detector) {
+    delete detector;
+}
+
+void mtcnn_set_min_face(mtcnn_detector *detector, int min_face) {
+    if (detector && min_face > 0)
+        detector->mtcnn.SetMinFace(min_face);
+}
+
+void mtcnn_set_threshold(mtcnn_detector *detector, float pnet, float rnet, float onet) {
+    if (detector)
+        detector->mtcnn.SetThreshold(pnet, rnet, onet);
+}
+
+void mtcnn_set_scale_factor(mtcnn_detector *detector, float factor) {
+    if (detector)
+        detector->mtcnn.SetScaleFactor(factor);
+}
+
+int mtcnn_set_fast_path(mtcnn_detector *detector, int enable) {
+    if (detector == NULL)
+        return 0;
+    bool pnet = detector->mtcnn.SetFusedPNet(enable != 0);
+    bool ronet = detector->mtcnn.SetFusedRONet(enable != 0);
+    detector->mtcnn.SetPyramidCanvas(enable != 0);
+    return enable && pnet && ronet ? 1 : 0;
+}
+
+void mtcnn_set_num_threads(mtcnn_detector *detector, int threads) {
+    if (detector)
+        detector->mtcnn.SetNumThreads(threads);
+}
+
+void mtcnn_set_stage_threads(mtcnn_detector *detector, int pnet, int rnet, int onet) {
+    if (detector == NULL)
+        return;
+    ThreadOptions options = detector->mtcnn.GetThreadOptions();
+    options.threads[0] = pnet;
+    options.threads[1] = rnet;
+    options.threads[2] = onet;
+    detector->mtcnn.SetThreadOptions(options);
+}
+
+int mtcnn_set_cpu_affinity(mtcnn_detector *detector, const char *cpus) {
+    if (detector == NULL)
+        return 0;
+    ThreadOptions options = detector->mtcnn.GetThreadOptions();
+    options.cpus.clear();
+    if (cpus && *cpus && !parseCpuList(cpus, options.cpus))
+        return 0;
+    return detector->mtcnn.SetThreadOptions(options) ? 1 : 0;
+}
+
+int mtcnn_set_numa_node(mtcnn_detector *detector, int node) {
+    if (detector == NULL || node >= numaNodeCount())
+        return 0;
+    ThreadOptions options = detector->mtcnn.GetThreadOptions();
+    options.numa_node = std::max(-1, node);
+    try {
+        return detector->mtcnn.SetThreadOptions(options) ? 1 : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+int mtcnn_warmup(mtcnn_detector *detector, int width, int height) {
+    if (detector == NULL || width <= 0 || height <= 0)
+        return 0;
+    try {
+        detector->mtcnn.warmup(width, height);
+    } catch (...) {
+        return 0;
+    }
+    return 1;
+}
+
+void mtcnn_enable_stats(mtcnn_detector *detector, int enable) {
+    if (detector == NULL)
+        return;
+    detector->stats_enabled = enable != 0;
+    detector->stats_valid = false;
+}
+
+int mtcnn_get_stats(const mtcnn_detector *detector, mtcnn_stats *stats) {
+    if (detector == NULL || stats == NULL || !detector->stats_valid)
+        return 0;
+    const DetectStats &s = detector->stats;
+    stats->pnet_ms = s.pnet.ms;
+    stats->rnet_ms = s.rnet.ms;
+    stats->onet_ms = s.onet.ms;
+    stats->total_ms = s.total_ms;
+    stats->pnet_candidates = s.pnet.candidates;
+    stats->pnet_kept = s.pnet.kept;
+    stats->rnet_candidates = s.rnet.candidates;
+    stats->rnet_kept = s.rnet.kept;
+    stats->onet_candidates = s.onet.candidates;
+    stats->onet_kept = s.onet.kept;
+    stats->pyramid_levels = (int) s.pyramid.size();
+    stats->allocations = s.allocations;
+    stats->allocated_bytes = s.allocated_bytes;
+    return 1;
+}
+
+int mtcnn_get_pool_stats(const mtcnn_detector *detector, mtcnn_pool_stats *stats) {
+    if (detector == NULL || stats == NULL)
+        return 0;
+    const PoolStats s = detector->mtcnn.GetPoolStats();
+    stats->requests = s.requests;
+    stats->hits = s.hits;
+    stats->requested_bytes = s.requested_bytes;
+    stats->cached_bytes = s.cached_bytes;
+    return 1;
+}
+
+// runs one detect call on pixels the caller keeps ownership of
+static int detectView(mtcnn_detector *detector, const ImageView &view, mtcnn_face *faces, int max_faces) {
+    if (detector == NULL)
+        return -1;
+    // a rejected call leaves no faces or stats of the previous one behind
+    detector->faces.clear();
+    detector->stats_valid = false;
+    if ((faces == NULL && max_faces > 0) || !view.valid())
+        return -1;
+    try {
+        detector->mtcnn.detect(view, detector->faces, detector->stats_enabled ? &detector->stats : NULL);
+    } catch (...) {
+        // no exception may cross the C boundary
+        detector->faces.clear();
+        return -1;
+    }
+    detector->stats_valid = detector->stats_enabled;
+    return mtcnn_get_faces(detector, faces, max_faces);
+}
+
+int mtcnn_detect_rgb(mtcnn_detector *detector, const unsigned char *rgb, int width, int height,
+                     int stride, mtcnn_face *faces, int max_faces) {
+    return mtcnn_detect_pixels(detector, rgb, MTCNN_PIXEL_RGB, width, height, stride, faces, max_faces);
+}
+
+static const PixelFormat packedFormats[] = {PIXEL_FORMAT_RGB, PIXEL_FORMAT_BGR, PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGRA};
+
+int mtcnn_detect_pixels(mtcnn_detector *detector, const unsigned char *pixels, mtcnn_pixel_format format,
+                        int width, int height, int stride, mtcnn_face *faces, int max_faces) {
+    if (format < MTCNN_PIXEL_RGB || format > MTCNN_PIXEL_BGRA || stride < 0)
+        return -1;
+    return detectView(detector, ImageView::fromPacked(pixels, packedFormats[format], width, height, stride), faces,
+                      max_faces);
+}
+
+int mtcnn_detect_nv12(mtcnn_detector *detector, const unsigned char *y, int y_stride,
+                      const unsigned char *uv, int uv_stride, int width, int height,
+                      mtcnn_face *faces, int max_faces) {
+    if (y_stride < 0 || uv_stride < 0)
+        return -1;
+    return detectView(detector, ImageView::fromNV12(y, y_stride, uv, uv_stride, width, height), faces, max_faces);
+}
+
+int mtcnn_detect_i420(mtcnn_detector *detector, const unsigned char *y, int y_stride,
+                      const unsigned char *u, int u_stride, const unsigned char *v, int v_stride,
+                      int width, int height, mtcnn_face *faces, int max_faces) {
+    if (y_stride < 0 || u_stride < 0 || v_stride < 0)
+        return -1;
+    return detectView(detector, ImageView::fromI420(y, y_stride, u, u_stride, v, v_stride, width, height), faces,
+                      max_faces);
+}
+
+int mtcnn_get_faces(const mtcnn_detector *detector, mtcnn_face *faces, int max_faces) {
+    if (detector == NULL || (faces == NULL && max_faces > 0))
+        return -1;
+    const int count = (int) detector->faces.size();
+    for (int i = 0; i < count && i < max_faces; i++) {
+        const Bbox &b = detector->faces[i];
+        mtcnn_face &f = faces[i];
+        f.score = b.score;
+        f.x1 = b.x1;
+        f.y1 = b.y1;
+        f.x2 = b.x2;
+        f.y2 = b.y2;
+        memcpy(f.landmarks, b.ppoint, sizeof(f.landmarks));
+    }
+    return count;
+}
+
+int mtcnn_extract_aligned_faces(const unsigned char *pixels, mtcnn_pixel_format format, int width, int height,
+                                int stride, const mtcnn_face *faces, int count, int size, unsigned char *out) {
+    if (format < MTCNN_PIXEL_RGB || format > MTCNN_PIXEL_BGRA || stride < 0 || count < 0 || size <= 0
+        || (count > 0 && (faces == NULL || out == NULL)))
+        return -1;
+    const ImageView view = ImageView::fromPacked(pixels, packedFormats[format], width, height, stride);
+    if (!view.valid())
+        return -1;
+    std::vector<FaceTransform> transforms(count);
+    for (int i = 0; i < count; i++)
+        transforms[i] = solveFaceTransform(faces[i].landmarks, size);
+    warpFaces(view, transforms.data(), count, size, out);
+    return count;
+}
+
+void mtcnn_trace_enable(int enable) {
+    traceEnable(enable != 0);
+}
+
+int mtcnn_trace_write(const char *filename) {
+    return filename && traceWrite(filename) ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#ifndef __MTCNN_C_H__
+#define __MTCNN_C_H__
+
+#include <stddef.h>
+
+// C interface of libmtcnn. A detector loads the three models once and can be
+// reused for any number of images; one detector must not be used by two
+// threads at the same time, create one per thread instead.
+
+#if defined(_WIN32)
+#if defined(MTCNN_BUILD_SHARED)
+#define MTCNN_API __declspec(dllexport)
+#elif defined(MTCNN_SHARED)
+#define MTCNN_API __declspec(dllimport)
+#else
+#define MTCNN_API
+#endif
+#else
+#define MTCNN_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MTCNN_API_VERSION 6
+
+typedef struct mtcnn_detector mtcnn_detector;
+
+typedef struct mtcnn_face {
+    float score;
+    int x1, y1, x2, y2;
+    // 5 landmark x coordinates followed by the 5 y coordinates:
+    // left eye, right eye, nose, left mouth corner, right mouth corner
+    float landmarks[10];
+} mtcnn_face;
+
+// packed 8 bit layouts for mtcnn_detect_pixels
+typedef enum mtcnn_pixel_format {
+    MTCNN_PIXEL_RGB = 0,
+    MTCNN_PIXEL_BGR = 1,
+    MTCNN_PIXEL_RGBA = 2,
+    MTCNN_PIXEL_BGRA = 3
+} mtcnn_pixel_format;
+
+typedef struct mtcnn_stats {
+    double pnet_ms, rnet_ms, onet_ms, total_ms;
+    int pnet_candidates, pnet_kept;
+    int rnet_candidates, rnet_kept;
+    int onet_candidates, onet_kept;
+    int pyramid_levels;
+    size_t allocations;
+    size_t allocated_bytes;
+} mtcnn_stats;
+
+typedef struct mtcnn_pool_stats {
+    size_t requests, hits;
+    size_t requested_bytes;
+    // freed buffers held for reuse
+    size_t cached_bytes;
+} mtcnn_pool_stats;
+
+MTCNN_API int mtcnn_api_version(void);
+
+// model_path holds det1/det2/det3 .param/.bin, returns NULL if they can not be loaded
+MTCNN_API mtcnn_detector *mtcnn_create(const char *model_path);
+
+MTCNN_API void mtcnn_destroy(mtcnn_detector *detector);
+
+MTCNN_API void mtcnn_set_min_face(mtcnn_detector *detector, int min_face);
+
+MTCNN_API void mtcnn_set_threshold(mtcnn_detector *detector, float pnet, float rnet, float onet);
+
+MTCNN_API void mtcnn_set_scale_factor(mtcnn_detector *detector, float factor);
+
+// fused P/R/O-Net kernels and the packed pyramid canvas, returns 1 if they are in use
+MTCNN_API int mtcnn_set_fast_path(mtcnn_detector *detector, int enable);
+
+// OpenMP threads used by the detector, 0 for the process default
+MTCNN_API void mtcnn_set_num_threads(mtcnn_detector *detector, int threads);
+
+MTCNN_API void mtcnn_set_stage_threads(mtcnn_detector *detector, int pnet, int rnet, int onet);
+
+// pins the detecting thread and its OpenMP team to a CPU list such as "0-3,8",
+// NULL or "" for no pinning. Returns 0 on a malformed list or if pinning is
+// not supported, applied from the next detect call.
+MTCNN_API int mtcnn_set_cpu_affinity(mtcnn_detector *detector, const char *cpus);
+
+// keeps weights and scratch memory on a NUMA node and runs on its CPUs unless
+// mtcnn_set_cpu_affinity chose others, -1 for none. Reloads the models,
+// returns 0 if the node can not be used.
+MTCNN_API int mtcnn_set_numa_node(mtcnn_detector *detector, int node);
+
+// runs one detect on a synthetic width x height image so the first real one
+// is as fast as the following ones; call it on the thread that detects.
+// Returns 0 on invalid arguments.
+MTCNN_API int mtcnn_warmup(mtcnn_detector *detector, int width, int height);
+
+// collects mtcnn_stats for every following detect call
+MTCNN_API void mtcnn_enable_stats(mtcnn_detector *detector, int enable);
+
+// stats of the last detect call, returns 0 if stats are not enabled
+MTCNN_API int mtcnn_get_stats(const mtcnn_detector *detector, mtcnn_stats *stats);
+
+// blob and workspace pool totals over the detector's lifetime, collected
+// whether stats are enabled or not; call it between detect calls
+MTCNN_API int mtcnn_get_pool_stats(const mtcnn_detector *detector, mtcnn_pool_stats *stats);
+
+// rgb is width x height RGB888 with stride bytes per row (0 for width * 3).
+// Writes at most max_faces faces and returns the number of faces found,
+// which can be larger than max_faces, or -1 on invalid arguments.
+MTCNN_API int mtcnn_detect_rgb(mtcnn_detector *detector, const unsigned char *rgb, int width, int height,
+                               int stride, mtcnn_face *faces, int max_faces);
+
+// The calls below behave like mtcnn_detect_rgb for other layouts. Pixels are
+// converted while they are sampled, only the ones the detector reads.
+// Strides are in bytes, 0 for tightly packed rows.
+MTCNN_API int mtcnn_detect_pixels(mtcnn_detector *detector, const unsigned char *pixels, mtcnn_pixel_format format,
+                                  int width, int height, int stride, mtcnn_face *faces, int max_faces);
+
+// BT.601 limited range, chroma planes hold (width + 1) / 2 x (height + 1) / 2 samples
+MTCNN_API int mtcnn_detect_nv12(mtcnn_detector *detector, const unsigned char *y, int y_stride,
+                                const unsigned char *uv, int uv_stride, int width, int height,
+                                mtcnn_face *faces, int max_faces);
+
+MTCNN_API int mtcnn_detect_i420(mtcnn_detector *detector, const unsigned char *y, int y_stride,
+                                const unsigned char *u, int u_stride, const unsigned char *v, int v_stride,
+                                int width, int height, mtcnn_face *faces, int max_faces);
+
+// copies the faces of the last detect call, for callers whose buffer was too small
+MTCNN_API int mtcnn_get_faces(const mtcnn_detector *detector, mtcnn_face *faces, int max_faces);
+
+#define MTCNN_ALIGNED_FACE_SIZE 112
+
+// Aligned face chips for recognition models. The landmarks of every face are
+// mapped onto the usual 112x112 five point template, scaled to size, by a
+// least squares similarity transform and only the chip is sampled. out
+// receives count chips of size x size RGB888, one after another
+// (count * size * size * 3 bytes). Returns count or -1 on invalid arguments.
+MTCNN_API int mtcnn_extract_aligned_faces(const unsigned char *pixels, mtcnn_pixel_format format, int width,
+                                          int height, int stride, const mtcnn_face *faces, int count, int size,
+                                          unsigned char *out);
+
+// process wide Chrome trace recording, see trace.h
+MTCNN_API void mtcnn_trace_enable(int enable);
+
+MTCNN_API int mtcnn_trace_write(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__MTCNN_C_H__
@@ -0,0 +1,219 @@
+#include "ncnn_model.h"
+#include "mat.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ncnn ModelBin flag tags for type 0 blobs
+static const unsigned int TAG_FP32 = 0;
+static const unsigned int TAG_FP16 = 0x01306B47;
+static const unsigned int TAG_INT8 = 0x000D4B38;
+
+int ModelLayer::getParam(int id, int def) const {
+    for (const auto &it : params) {
+        if (it.first == id)
+            return atoi(it.second.c_str());
+    }
+    return def;
+}
+
+void ModelLayer::setParam(int id, const std::string &value) {
+    for (auto &it : params) {
+        if (it.first == id) {
+            it.second = value;
+            return;
+        }
+    }
+    params.push_back(std::make_pair(id, value));
+}
+
+bool ModelLayer::hasWeights() const {
+    return type == "Convolution" || type == "InnerProduct";
+}
+
+int ModelLayer::numOutput() const {
+    return getParam(0, 0);
+}
+
+static bool readRaw(FILE *fp, int count, std::vector<float> &out) {
+    out.resize(count);
+    return fread(out.data(), sizeof(float), count, fp) == (size_t) count;
+}
+
+static bool readTagged(FILE *fp, int count, std::vector<float> &out, int &storage) {
+    unsigned int tag = 0;
+    if (fread(&tag, sizeof(tag), 1, fp) != 1)
+        return false;
+    out.resize(count);
+    if (tag == TAG_FP32) {
+        storage = WEIGHT_FP32;
+        return fread(out.data(), sizeof(float), count, fp) == (size_t) count;
+    }
+    if (tag == TAG_FP16) {
+        storage = WEIGHT_FP16;
+        std::vector<unsigned short> half(ncnn::alignSize(count * sizeof(unsigned short), 4) / sizeof(unsigned short));
+        if (fread(half.data(), sizeof(unsigned short), half.size(), fp) != half.size())
+            return false;
+        for (int i = 0; i < count; i++)
+            out[i] = ncnn::float16_to_float32(half[i]);
+        return true;
+    }
+    if (tag == TAG_INT8) {
+        storage = WEIGHT_INT8;
+        std::vector<signed char> q(ncnn::alignSize(count, 4));
+        if (fread(q.data(), 1, q.size(), fp) != q.size())
+            return false;
+        for (int i = 0; i < count; i++)
+            out[i] = q[i];
+        return true;
+    }
+    fprintf(stderr, "unsupported weight tag 0x%08x\n", tag);
+    return false;
+}
+
+static bool writeRaw(FILE *fp, const std::vector<float> &data) {
+    return fwrite(data.data(), sizeof(float), data.size(), fp) == data.size();
+}
+
+static bool writeTagged(FILE *fp, const std::vector<float> &data, int storage) {
+    if (storage == WEIGHT_FP16) {
+        std::vector<unsigned short> half(ncnn::alignSize(data.size() * sizeof(unsigned short), 4) / sizeof(unsigned short), 0);
+        for (size_t i = 0; i < data.size(); i++)
+            half[i] = ncnn::float32_to_float16(data[i]);
+        return fwrite(&TAG_FP16, sizeof(TAG_FP16), 1, fp) == 1
+               && fwrite(half.data(), sizeof(unsigned short), half.size(), fp) == half.size();
+    }
+    if (storage == WEIGHT_INT8) {
+        std::vector<signed char> q(ncnn::alignSize(data.size(), 4), 0);
+        for (size_t i = 0; i < data.size(); i++)
+            q[i] = (signed char) data[i];
+        return fwrite(&TAG_INT8, sizeof(TAG_INT8), 1, fp) == 1
+               && fwrite(q.data(), 1, q.size(), fp) == q.size();
+    }
+    return fwrite(&TAG_FP32, sizeof(TAG_FP32), 1, fp) == 1 && writeRaw(fp, data);
+}
+
+bool ModelFile::load(const std::string &param_file, const std::string &bin_file) {
+    layers.clear();
+    FILE *pp = fopen(param_file.c_str(), "rb");
+    if (pp == NULL) {
+        fprintf(stderr, "open %s failed\n", param_file.c_str());
+        return false;
+    }
+    int magic = 0;
+    int layer_count = 0;
+    blob_count = 0;
+    bool ok = fscanf(pp, "%d", &magic) == 1 && magic == 7767517
+              && fscanf(pp, "%d %d", &layer_count, &blob_count) == 2;
+    for (int i = 0; ok && i < layer_count; i++) {
+        ModelLayer layer;
+        char type[256], name[256];
+        int bottom_count = 0, top_count = 0;
+        ok = fscanf(pp, "%255s %255s %d %d", type, name, &bottom_count, &top_count) == 4;
+        layer.type = type;
+        layer.name = name;
+        layer.bottom_scale = 0.f;
+        layer.storage = WEIGHT_FP32;
+        for (int j = 0; ok && j < bottom_count + top_count; j++) {
+            char blob[256];
+            ok = fscanf(pp, "%255s", blob) == 1;
+            (j < bottom_count ? layer.bottoms : layer.tops).push_back(blob);
+        }
+        int c = 0;
+        while (ok && (c = fgetc(pp)) != EOF && c != '\n') {
+            if (c == ' ' || c == '\t' || c == '\r')
+                continue;
+            ungetc(c, pp);
+            int id = 0;
+            char value[256];
+            ok = fscanf(pp, "%d=%255s", &id, value) == 2;
+            layer.params.push_back(std::make_pair(id, std::string(value)));
+        }
+        layers.push_back(layer);
+    }
+    fclose(pp);
+    if (!ok) {
+        fprintf(stderr, "parse %s failed\n", param_file.c_str());
+        return false;
+    }
+
+    FILE *bp = fopen(bin_file.c_str(), "rb");
+    if (bp == NULL) {
+        fprintf(stderr, "open %s failed\n", bin_file.c_str());
+        return false;
+    }
+    for (auto &layer : layers) {
+        if (!ok)
+            break;
+        if (layer.hasWeights()) {
+            bool conv = layer.type == "Convolution";
+            int num_output = layer.numOutput();
+            ok = readTagged(bp, layer.getParam(conv ? 6 : 2, 0), layer.weight, layer.storage);
+            if (ok && layer.getParam(conv ? 5 : 1, 0))
+                ok = readRaw(bp, num_output, layer.bias);
+            if (ok && layer.getParam(8, 0)) {
+                std::vector<float> bottom_scale;
+                ok = readRaw(bp, num_output, layer.weight_scales) && readRaw(bp, 1, bottom_scale);
+                layer.bottom_scale = ok ? bottom_scale[0] : 0.f;
+            }
+        } else if (layer.type == "PReLU") {
+            ok = readRaw(bp, layer.getParam(0, 0), layer.slope);
+        }
+    }
+    fclose(bp);
+    if (!ok)
+        fprintf(stderr, "read %s failed\n", bin_file.c_str());
+    return ok;
+}
+
+bool ModelFile::save(const std::string &param_file, const std::string &bin_file) const {
+    FILE *pp = fopen(param_file.c_str(), "wb");
+    if (pp == NULL) {
+        fprintf(stderr, "open %s failed\n", param_file.c_str());
+        return false;
+    }
+    fprintf(pp, "7767517\n%d %d\n", (int) layers.size(), blob_count);
+    for (const auto &layer : layers) {
+        fprintf(pp, "%-16s %-16s %d %d", layer.type.c_str(), layer.name.c_str(),
+                (int) layer.bottoms.size(), (int) layer.tops.size());
+        for (const auto &blob : layer.bottoms)
+            fprintf(pp, " %s", blob.c_str());
+        for (const auto &blob : layer.tops)
+            fprintf(pp, " %s", blob.c_str());
+        for (const auto &param : layer.params)
+            fprintf(pp, " %d=%s", param.first, param.second.c_str());
+        fprintf(pp, "\n");
+    }
+    fclose(pp);
+
+    FILE *bp = fopen(bin_file.c_str(), "wb");
+    if (bp == NULL) {
+        fprintf(stderr, "open %s failed\n", bin_file.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (const auto &layer : layers) {
+        if (!ok)
+            break;
+        if (layer.hasWeights()) {
+            ok = writeTagged(bp, layer.weight, layer.storage);
+            if (ok && !layer.bias.empty())
+                ok = writeRaw(bp, layer.bias);
+            if (ok && layer.getParam(8, 0))
+                ok = writeRaw(bp, layer.weight_scales) && writeRaw(bp, std::vector<float>(1, layer.bottom_scale));
+        } else if (layer.type == "PReLU") {
+            ok = writeRaw(bp, layer.slope);
+        }
+    }
+    fclose(bp);
+    if (!ok)
+        fprintf(stderr, "write %s failed\n", bin_file.c_str());
+    return ok;
+}
+
+const ModelLayer *ModelFile::find(const std::string &name) const {
+    for (const auto &layer : layers) {
+        if (layer.name == name)
+            return &layer;
+    }
+    return NULL;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef __MTCNN_NCNN_MODEL_H__
+#define __MTCNN_NCNN_MODEL_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+// Minimal reader/writer for the ncnn .param/.bin pairs in models/.
+// Only the layer types used by det1/det2/det3 carry weights here:
+// Convolution, InnerProduct and PReLU.
+
+enum WeightStorage {
+    WEIGHT_FP32 = 0,
+    WEIGHT_FP16 = 1,
+    WEIGHT_INT8 = 2
+};
+
+struct ModelLayer {
+    std::string type;
+    std::string name;
+    std::vector<std::string> bottoms;
+    std::vector<std::string> tops;
+    std::vector<std::pair<int, std::string> > params;
+
+    // int8 weights are kept as their integer values, see weight_scales
+    std::vector<float> weight;
+    std::vector<float> bias;
+    std::vector<float> slope;
+    std::vector<float> weight_scales;
+    float bottom_scale;
+    int storage;
+
+    int getParam(int id, int def) const;
+
+    void setParam(int id, const std::string &value);
+
+    bool hasWeights() const;
+
+    int numOutput() const;
+};
+
+struct ModelFile {
+    std::vector<ModelLayer> layers;
+    int blob_count;
+
+    bool load(const std::string &param_file, const std::string &bin_file);
+
+    bool save(const std::string &param_file, const std::string &bin_file) const;
+
+    const ModelLayer *find(const std::string &name) const;
+};
+
+#endif //__MTCNN_NCNN_MODEL_H__
@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef __MTCNN_PIXEL_CONVERT_H__
+#define __MTCNN_PIXEL_CONVERT_H__
+
+// Pixel helpers shared by the sampler, face alignment, the image ops and the
+// stream tool: vector ISA selection, float to byte rounding and BT.601 YUV to
+// RGB. Header only, so tools that just link the C API can use it as well.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_X86
+// AVX2 kernels are compiled per function and picked at run time
+#define PIXEL_AVX2
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define PIXEL_X86
+#include <immintrin.h>
+#define TARGET_SSE2
+#elif defined(__ARM_NEON)
+#define PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+enum PixelIsa {
+    PIXEL_ISA_SCALAR,
+    PIXEL_ISA_SSE2,
+    PIXEL_ISA_AVX2,
+    PIXEL_ISA_NEON
+};
+
+static inline PixelIsa detectPixelIsa() {
+#if defined(PIXEL_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return PIXEL_ISA_AVX2;
+    return __builtin_cpu_supports("sse2") ? PIXEL_ISA_SSE2 : PIXEL_ISA_SCALAR;
+#elif defined(PIXEL_X86)
+    return PIXEL_ISA_SSE2;
+#elif defined(PIXEL_NEON)
+    return PIXEL_ISA_NEON;
+#else
+    return PIXEL_ISA_SCALAR;
+#endif
+}
+
+// best vector ISA of this CPU the kernels were compiled for
+static inline PixelIsa pixelIsa() {
+    static const PixelIsa isa = detectPixelIsa();
+    return isa;
+}
+
+// round to nearest, clamped to 0..255
+static inline unsigned char toByte(float v) {
+    return (unsigned char) (v < 0.f ? 0 : (v > 255.f ? 255 : (int) (v + 0.5f)));
+}
+
+static inline float clampPixel(float v) {
+    return v < 0.f ? 0.f : (v > 255.f ? 255.f : v);
+}
+
+// BT.601 YUV to RGB, y_offset and y_scale expand limited range luma
+struct YuvCoeffs {
+    float y_offset, y_scale;
+    float rv, gu, gv, bu;
+};
+
+static const YuvCoeffs BT601_LIMITED = {16.f, 1.164383f, 1.596027f, 0.391762f, 0.812968f, 2.017232f};
+static const YuvCoeffs BT601_FULL = {0.f, 1.f, 1.402f, 0.344136f, 0.714136f, 1.772f};
+
+// unclamped RGB of one sample, u and v centered on 0
+static inline void yuvToRgb(const YuvCoeffs &k, float y, float u, float v, float rgb[3]) {
+    const float c = k.y_scale * (y - k.y_offset);
+    rgb[0] = c + k.rv * v;
+    rgb[1] = c - k.gu * u - k.gv * v;
+    rgb[2] = c + k.bu * u;
+}
+
+// Y plane plus 2x2 subsampled U and V, chroma_step 2 for the interleaved UV of NV12
+struct YuvPlanes {
+    const unsigned char *y, *u, *v;
+    int y_stride, u_stride, v_stride;
+    int chroma_step;
+};
+
+// Bilinear RGB sample between the rows y0, y1 and the columns x0, x1 with
+// weights a0, a1 across and b0, b1 down. Y, U and V are interpolated
+// separately (chroma nearest per tap, as a full frame conversion would
+// upsample it) and converted once.
+static inline void sampleYuv(const YuvPlanes &p, int x0, int x1, int y0, int y1, float a0, float a1, float b0,
+                             float b1, float rgb[3]) {
+    const unsigned char *l0 = p.y + (size_t) y0 * p.y_stride, *l1 = p.y + (size_t) y1 * p.y_stride;
+    const unsigned char *u0 = p.u + (size_t) (y0 >> 1) * p.u_stride, *u1 = p.u + (size_t) (y1 >> 1) * p.u_stride;
+    const unsigned char *v0 = p.v + (size_t) (y0 >> 1) * p.v_stride, *v1 = p.v + (size_t) (y1 >> 1) * p.v_stride;
+    const int c0 = (x0 >> 1) * p.chroma_step, c1 = (x1 >> 1) * p.chroma_step;
+    const float luma = (l0[x0] * a0 + l0[x1] * a1) * b0 + (l1[x0] * a0 + l1[x1] * a1) * b1;
+    const float u = (u0[c0] * a0 + u0[c1] * a1) * b0 + (u1[c0] * a0 + u1[c1] * a1) * b1 - 128.f;
+    const float v = (v0[c0] * a0 + v0[c1] * a1) * b0 + (v1[c0] * a0 + v1[c1] * a1) * b1 - 128.f;
+    yuvToRgb(BT601_LIMITED, luma, u, v, rgb);
+}
+
+#endif //__MTCNN_PIXEL_CONVERT_H__
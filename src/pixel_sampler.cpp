@@ -0,0 +1,164 @@
+#include "pixel_sampler.h"
+#include "pixel_convert.h"
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+ImageView ImageView::fromPacked(const unsigned char *pixels, PixelFormat format, int width, int height, int stride) {
+    ImageView view = {format, {pixels, NULL, NULL}, {0, 0, 0}, width, height};
+    view.stride[0] = stride > 0 ? stride : width * view.pixelBytes();
+    return view;
+}
+
+ImageView ImageView::fromNV12(const unsigned char *y, int y_stride, const unsigned char *uv, int uv_stride,
+                              int width, int height) {
+    const int chroma_w = (width + 1) / 2;
+    ImageView view = {PIXEL_FORMAT_NV12, {y, uv, NULL},
+                      {y_stride > 0 ? y_stride : width, uv_stride > 0 ? uv_stride : chroma_w * 2, 0}, width, height};
+    return view;
+}
+
+ImageView ImageView::fromI420(const unsigned char *y, int y_stride, const unsigned char *u, int u_stride,
+                              const unsigned char *v, int v_stride, int width, int height) {
+    const int chroma_w = (width + 1) / 2;
+    ImageView view = {PIXEL_FORMAT_I420, {y, u, v},
+                      {y_stride > 0 ? y_stride : width, u_stride > 0 ? u_stride : chroma_w,
+                       v_stride > 0 ? v_stride : chroma_w}, width, height};
+    return view;
+}
+
+int ImageView::pixelBytes() const {
+    switch (format) {
+        case PIXEL_FORMAT_RGB:
+        case PIXEL_FORMAT_BGR:
+            return 3;
+        case PIXEL_FORMAT_RGBA:
+        case PIXEL_FORMAT_BGRA:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+YuvPlanes ImageView::yuvPlanes() const {
+    // NV12 keeps U and V next to each other in plane 1
+    const bool nv12 = format == PIXEL_FORMAT_NV12;
+    YuvPlanes planes = {data[0], data[1], nv12 ? data[1] + 1 : data[2], stride[0], stride[1],
+                        nv12 ? stride[1] : stride[2], nv12 ? 2 : 1};
+    return planes;
+}
+
+bool ImageView::valid() const {
+    if (width <= 0 || height <= 0 || data[0] == NULL || stride[0] < width * pixelBytes())
+        return false;
+    const int chroma_w = (width + 1) / 2;
+    if (format == PIXEL_FORMAT_NV12)
+        return data[1] != NULL && stride[1] >= chroma_w * 2;
+    if (format == PIXEL_FORMAT_I420)
+        return data[1] != NULL && data[2] != NULL && stride[1] >= chroma_w && stride[2] >= chroma_w;
+    return format >= PIXEL_FORMAT_RGB && format <= PIXEL_FORMAT_BGRA;
+}
+
+// same sample positions as ncnn's linear_coeffs, offset by the rect origin;
+// ofs1 is the second tap, clamped so a 1 pixel wide rect stays inside
+static void linearCoeffs(int offset, int w, int outw, std::vector<int> &ofs0, std::vector<int> &ofs1,
+                         std::vector<float> &alpha) {
+    ofs0.resize(outw);
+    ofs1.resize(outw);
+    alpha.resize(outw * 2);
+    double scale = (double) w / outw;
+    for (int dx = 0; dx < outw; dx++) {
+        float fx = (float) ((dx + 0.5) * scale - 0.5);
+        int sx = (int) floor(fx);
+        fx -= sx;
+        if (sx < 0) {
+            sx = 0;
+            fx = 0.f;
+        }
+        if (sx >= w - 1) {
+            sx = std::max(0, w - 2);
+            fx = w > 1 ? 1.f : 0.f;
+        }
+        ofs0[dx] = offset + sx;
+        ofs1[dx] = offset + std::min(sx + 1, w - 1);
+        alpha[dx * 2] = 1.f - fx;
+        alpha[dx * 2 + 1] = fx;
+    }
+}
+
+static void samplePacked(const ImageView &src, const std::vector<int> &xofs0, const std::vector<int> &xofs1,
+                         const std::vector<float> &alpha, const std::vector<int> &yofs0, const std::vector<int> &yofs1,
+                         const std::vector<float> &beta, float mean, float norm, ncnn::Mat &dst) {
+    const int bpp = src.pixelBytes();
+    const bool bgr = src.format == PIXEL_FORMAT_BGR || src.format == PIXEL_FORMAT_BGRA;
+    const int r = bgr ? 2 : 0, b = bgr ? 0 : 2;
+    float *dr = dst.channel(0), *dg = dst.channel(1), *db = dst.channel(2);
+    for (int y = 0; y < dst.h; y++) {
+        const unsigned char *row0 = src.data[0] + (size_t) yofs0[y] * src.stride[0];
+        const unsigned char *row1 = src.data[0] + (size_t) yofs1[y] * src.stride[0];
+        const float b0 = beta[y * 2], b1 = beta[y * 2 + 1];
+        for (int x = 0; x < dst.w; x++) {
+            const unsigned char *p00 = row0 + xofs0[x] * bpp, *p01 = row0 + xofs1[x] * bpp;
+            const unsigned char *p10 = row1 + xofs0[x] * bpp, *p11 = row1 + xofs1[x] * bpp;
+            const float a0 = alpha[x * 2], a1 = alpha[x * 2 + 1];
+            float v0 = p00[r] * a0 + p01[r] * a1, v1 = p10[r] * a0 + p11[r] * a1;
+            *dr++ = (v0 * b0 + v1 * b1 - mean) * norm;
+            v0 = p00[1] * a0 + p01[1] * a1, v1 = p10[1] * a0 + p11[1] * a1;
+            *dg++ = (v0 * b0 + v1 * b1 - mean) * norm;
+            v0 = p00[b] * a0 + p01[b] * a1, v1 = p10[b] * a0 + p11[b] * a1;
+            *db++ = (v0 * b0 + v1 * b1 - mean) * norm;
+        }
+    }
+}
+
+// converted once per output pixel, see sampleYuv
+static void sampleYUV(const ImageView &src, const std::vector<int> &xofs0, const std::vector<int> &xofs1,
+                      const std::vector<float> &alpha, const std::vector<int> &yofs0, const std::vector<int> &yofs1,
+                      const std::vector<float> &beta, float mean, float norm, ncnn::Mat &dst) {
+    const YuvPlanes planes = src.yuvPlanes();
+    float *dr = dst.channel(0), *dg = dst.channel(1), *db = dst.channel(2);
+    for (int y = 0; y < dst.h; y++) {
+        const int y0 = yofs0[y], y1 = yofs1[y];
+        const float b0 = beta[y * 2], b1 = beta[y * 2 + 1];
+        for (int x = 0; x < dst.w; x++) {
+            float rgb[3];
+            sampleYuv(planes, xofs0[x], xofs1[x], y0, y1, alpha[x * 2], alpha[x * 2 + 1], b0, b1, rgb);
+            *dr++ = (clampPixel(rgb[0]) - mean) * norm;
+            *dg++ = (clampPixel(rgb[1]) - mean) * norm;
+            *db++ = (clampPixel(rgb[2]) - mean) * norm;
+        }
+    }
+}
+
+void sampleCoeffs(int x, int y, int w, int h, int dst_w, int dst_h, SampleCoeffs &coeffs) {
+    coeffs.dst_w = dst_w;
+    coeffs.dst_h = dst_h;
+    if (w <= 0 || h <= 0 || dst_w <= 0 || dst_h <= 0) {
+        coeffs.dst_w = coeffs.dst_h = 0;
+        return;
+    }
+    linearCoeffs(x, w, dst_w, coeffs.xofs0, coeffs.xofs1, coeffs.alpha);
+    linearCoeffs(y, h, dst_h, coeffs.yofs0, coeffs.yofs1, coeffs.beta);
+}
+
+void samplePixels(const ImageView &src, const SampleCoeffs &coeffs, float mean, float norm, ncnn::Mat &dst,
+                  ncnn::Allocator *allocator) {
+    if (coeffs.dst_w <= 0 || coeffs.dst_h <= 0) {
+        dst = ncnn::Mat();
+        return;
+    }
+    dst.create(coeffs.dst_w, coeffs.dst_h, 3, 4u, allocator);
+    if (src.format == PIXEL_FORMAT_NV12 || src.format == PIXEL_FORMAT_I420)
+        sampleYUV(src, coeffs.xofs0, coeffs.xofs1, coeffs.alpha, coeffs.yofs0, coeffs.yofs1, coeffs.beta, mean,
+                  norm, dst);
+    else
+        samplePacked(src, coeffs.xofs0, coeffs.xofs1, coeffs.alpha, coeffs.yofs0, coeffs.yofs1, coeffs.beta, mean,
+                     norm, dst);
+}
+
+void samplePixels(const ImageView &src, int x, int y, int w, int h, int dst_w, int dst_h, float mean, float norm,
+                  ncnn::Mat &dst, ncnn::Allocator *allocator) {
+    SampleCoeffs coeffs;
+    sampleCoeffs(x, y, w, h, dst_w, dst_h, coeffs);
+    samplePixels(src, coeffs, mean, norm, dst, allocator);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef __MTCNN_PIXEL_SAMPLER_H__
+#define __MTCNN_PIXEL_SAMPLER_H__
+
+#include "mat.h"
+#include <vector>
+
+struct YuvPlanes;
+
+// 8 bit input layouts the detector reads directly. YUV is BT.601 limited
+// range with 2x2 subsampled chroma.
+enum PixelFormat {
+    PIXEL_FORMAT_RGB,
+    PIXEL_FORMAT_BGR,
+    PIXEL_FORMAT_RGBA,
+    PIXEL_FORMAT_BGRA,
+    // Y plane + interleaved UV plane
+    PIXEL_FORMAT_NV12,
+    // Y, U and V planes
+    PIXEL_FORMAT_I420
+};
+
+// Caller owned pixels the detector reads in place: nothing is copied, the
+// planes only have to stay valid for the duration of the detect call.
+// Packed formats only use plane 0, strides are in bytes.
+struct ImageView {
+    PixelFormat format;
+    const unsigned char *data[3];
+    int stride[3];
+    int width, height;
+
+    // stride 0 means tightly packed rows
+    static ImageView fromPacked(const unsigned char *pixels, PixelFormat format, int width, int height,
+                                int stride = 0);
+
+    static ImageView fromNV12(const unsigned char *y, int y_stride, const unsigned char *uv, int uv_stride,
+                              int width, int height);
+
+    static ImageView fromI420(const unsigned char *y, int y_stride, const unsigned char *u, int u_stride,
+                              const unsigned char *v, int v_stride, int width, int height);
+
+    // bytes per pixel of plane 0
+    int pixelBytes() const;
+
+    // the planes of an NV12 or I420 view
+    YuvPlanes yuvPlanes() const;
+
+    // non empty, all planes set and every stride covers a row
+    bool valid() const;
+};
+
+// Bilinear resize of the rect x, y, w, h of src to a dst_w x dst_h RGB float
+// Mat normalized with (v - mean) * norm. Samples the same positions as ncnn
+// resize_bilinear, but only the source pixels it touches are converted.
+void samplePixels(const ImageView &src, int x, int y, int w, int h, int dst_w, int dst_h, float mean, float norm,
+                  ncnn::Mat &dst, ncnn::Allocator *allocator = 0);
+
+// sample positions and weights of one rect -> dst_w x dst_h resize, they only
+// depend on the geometry and can be kept for every image of the same size
+struct SampleCoeffs {
+    int dst_w = 0, dst_h = 0;
+    std::vector<int> xofs0, xofs1, yofs0, yofs1;
+    std::vector<float> alpha, beta;
+};
+
+void sampleCoeffs(int x, int y, int w, int h, int dst_w, int dst_h, SampleCoeffs &coeffs);
+
+// samplePixels with precomputed coefficients; dst keeps its buffer when it
+// already has the output shape and allocator
+void samplePixels(const ImageView &src, const SampleCoeffs &coeffs, float mean, float norm, ncnn::Mat &dst,
+                  ncnn::Allocator *allocator = 0);
+
+#endif //__MTCNN_PIXEL_SAMPLER_H__
@@ -0,0 +1,134 @@
+#include "pnet_fused.h"
+#include "fused_kernels.h"
+#include "trace.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// output rows per OpenMP band, each band recomputes a 4 row halo
+static const int BAND_ROWS = 16;
+
+bool FusedPNet::load(const ModelFile &model) {
+    float score_w[C3 * 2], score_b[2], box_w[C3 * 4], box_b[4];
+    if (!packConv(model, "conv1", C0, C1, 3, w1, b1) || !packPReLU(model, "PReLU1", C1, a1)
+        || !packConv(model, "conv2", C1, C2, 3, w2, b2) || !packPReLU(model, "PReLU2", C2, a2)
+        || !packConv(model, "conv3", C2, C3, 3, w3, b3) || !packPReLU(model, "PReLU3", C3, a3)
+        || !packConv(model, "conv4-1", C3, 2, 1, score_w, score_b)
+        || !packConv(model, "conv4-2", C3, 4, 1, box_w, box_b))
+        return false;
+    for (int i = 0; i < C3; i++) {
+        for (int o = 0; o < 2; o++)
+            w4[i * 6 + o] = score_w[i * 2 + o];
+        for (int o = 0; o < 4; o++)
+            w4[i * 6 + 2 + o] = box_w[i * 4 + o];
+    }
+    memcpy(b4, score_b, sizeof(score_b));
+    memcpy(b4 + 2, box_b, sizeof(box_b));
+    return true;
+}
+
+void FusedPNet::forwardRows(const ncnn::Mat &in, int row_begin, int row_end,
+                            ncnn::Mat &score, ncnn::Mat &location) const {
+    const int w = in.w;
+    const int cw1 = w - 2, ch1 = in.h - 2;
+    const int pw = (cw1 + 1) / 2;
+    const int cw2 = pw - 2;
+    const int cw3 = cw2 - 2;
+
+    // kept per thread between bands and calls, so the OpenMP team stays off the heap
+    static thread_local std::vector<float> buffer;
+    buffer.assign(4 * w * C0 + 2 * cw1 * C1 + 3 * pw * C1 + 3 * cw2 * C2 + cw3 * C3, 0.f);
+    float *input_rows = buffer.data();
+    float *conv1_rows = input_rows + 4 * w * C0;
+    float *pool_ring = conv1_rows + 2 * cw1 * C1;
+    float *conv2_ring = pool_ring + 3 * pw * C1;
+    float *conv3_row = conv2_ring + 3 * cw2 * C2;
+
+    const float *planes[C0] = {in.channel(0), in.channel(1), in.channel(2)};
+    for (int p = row_begin; p < row_end + 4; p++) {
+        // conv1 rows 2p and 2p + 1 from input rows 2p .. 2p + 3, pooled into row p
+        const int conv1_count = std::min(2, ch1 - 2 * p);
+        for (int r = 0; r < conv1_count + 2; r++) {
+            const float *src[C0];
+            for (int c = 0; c < C0; c++)
+                src[c] = planes[c] + (2 * p + r) * w;
+            float *dst = input_rows + r * w * C0;
+            for (int x = 0; x < w; x++) {
+                for (int c = 0; c < C0; c++)
+                    dst[x * C0 + c] = src[c][x];
+            }
+        }
+        for (int r = 0; r < conv1_count; r++) {
+            const float *rows[3] = {input_rows + r * w * C0, input_rows + (r + 1) * w * C0,
+                                    input_rows + (r + 2) * w * C0};
+            convRow<C0, C1, 3>(rows, cw1, w1, b1, a1, conv1_rows + r * cw1 * C1);
+        }
+        float *pool = pool_ring + (p % 3) * pw * C1;
+        for (int x = 0; x < pw; x++) {
+            const int x1 = std::min(2 * x + 1, cw1 - 1);
+            for (int c = 0; c < C1; c++) {
+                float m = std::max(conv1_rows[2 * x * C1 + c], conv1_rows[x1 * C1 + c]);
+                if (conv1_count == 2)
+                    m = std::max(m, std::max(conv1_rows[(cw1 + 2 * x) * C1 + c], conv1_rows[(cw1 + x1) * C1 + c]));
+                pool[x * C1 + c] = m;
+            }
+        }
+        if (p < row_begin + 2)
+            continue;
+
+        const int r2 = p - 2;
+        const float *pool_rows[3] = {pool_ring + (r2 % 3) * pw * C1, pool_ring + ((r2 + 1) % 3) * pw * C1,
+                                     pool_ring + ((r2 + 2) % 3) * pw * C1};
+        convRow<C1, C2, 3>(pool_rows, cw2, w2, b2, a2, conv2_ring + (r2 % 3) * cw2 * C2);
+        if (r2 < row_begin + 2)
+            continue;
+
+        const int r3 = r2 - 2;
+        const float *conv2_rows[3] = {conv2_ring + (r3 % 3) * cw2 * C2, conv2_ring + ((r3 + 1) % 3) * cw2 * C2,
+                                      conv2_ring + ((r3 + 2) % 3) * cw2 * C2};
+        convRow<C2, C3, 3>(conv2_rows, cw3, w3, b3, a3, conv3_row);
+        float *prob0 = score.channel(0).row(r3);
+        float *prob1 = score.channel(1).row(r3);
+        float *box[4];
+        for (int c = 0; c < 4; c++)
+            box[c] = location.channel(c).row(r3);
+        for (int x = 0; x < cw3; x++) {
+            float acc[6];
+            for (int o = 0; o < 6; o++)
+                acc[o] = b4[o];
+            const float *src = conv3_row + x * C3;
+            for (int i = 0; i < C3; i++) {
+                for (int o = 0; o < 6; o++)
+                    acc[o] += src[i] * w4[i * 6 + o];
+            }
+            const float m = std::max(acc[0], acc[1]);
+            const float e0 = expf(acc[0] - m);
+            const float e1 = expf(acc[1] - m);
+            prob0[x] = e0 / (e0 + e1);
+            prob1[x] = e1 / (e0 + e1);
+            for (int c = 0; c < 4; c++)
+                box[c][x] = acc[2 + c];
+        }
+    }
+}
+
+void FusedPNet::forward(const ncnn::Mat &in, ncnn::Mat &score, ncnn::Mat &location,
+                        ncnn::Allocator *allocator) const {
+    const int pw = (in.w - 1) / 2;
+    const int ph = (in.h - 1) / 2;
+    const int outw = pw - 4;
+    const int outh = ph - 4;
+    if (in.c != C0 || outw < 1 || outh < 1) {
+        score = ncnn::Mat();
+        location = ncnn::Mat();
+        return;
+    }
+    score.create(outw, outh, 2, 4u, allocator);
+    location.create(outw, outh, 4, 4u, allocator);
+    const int bands = (outh + BAND_ROWS - 1) / BAND_ROWS;
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < bands; band++) {
+        TRACE_SCOPE("pnet_band", "band", band);
+        forwardRows(in, band * BAND_ROWS, std::min(outh, (band + 1) * BAND_ROWS), score, location);
+    }
+}
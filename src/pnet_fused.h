@@ -0,0 +1,34 @@
+#pragma once
+
+#ifndef __MTCNN_PNET_FUSED_H__
+#define __MTCNN_PNET_FUSED_H__
+
+#include "net.h"
+#include "ncnn_model.h"
+
+// Hand-specialized PNet (det1.param): 3->10 conv3x3, PReLU, maxpool 2x2,
+// 10->16 conv3x3, PReLU, 16->32 conv3x3, PReLU, 1x1 heads and softmax.
+// Rows are streamed through small channel-interleaved ring buffers, so every
+// intermediate row stays in L1 and no full feature map is ever materialized.
+class FusedPNet {
+public:
+    static const int C0 = 3, C1 = 10, C2 = 16, C3 = 32;
+
+    // packs the weights of a det1 model, fails on int8 or a different topology
+    bool load(const ModelFile &model);
+
+    // same outputs as the "prob1" and "conv4-2" blobs of the ncnn graph, allocated from allocator
+    void forward(const ncnn::Mat &in, ncnn::Mat &score, ncnn::Mat &location, ncnn::Allocator *allocator = 0) const;
+
+private:
+    void forwardRows(const ncnn::Mat &in, int row_begin, int row_end, ncnn::Mat &score, ncnn::Mat &location) const;
+
+    // conv weights packed as [ky][kx][ic][oc]
+    float w1[3 * 3 * C0 * C1], b1[C1], a1[C1];
+    float w2[3 * 3 * C1 * C2], b2[C2], a2[C2];
+    float w3[3 * 3 * C2 * C3], b3[C3], a3[C3];
+    // both 1x1 heads as one [ic][6] matrix, 2 score logits then 4 offsets
+    float w4[C3 * 6], b4[6];
+};
+
+#endif //__MTCNN_PNET_FUSED_H__
@@ -0,0 +1,250 @@
+#include "result_writer.h"
+#include <string.h>
+
+static_assert(sizeof(ResultRecord) == 80, "ResultRecord is part of the file format");
+
+bool parseResultFormat(const char *name, ResultFormat &format) {
+    if (strcmp(name, "json") == 0)
+        format = RESULT_JSON;
+    else if (strcmp(name, "binary") == 0)
+        format = RESULT_BINARY;
+    else
+        return false;
+    return true;
+}
+
+ResultWriter::~ResultWriter() {
+    close();
+}
+
+bool ResultWriter::open(const char *path, ResultFormat format_) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex);
+    ownsFile = strcmp(path, "-") != 0;
+    fp = ownsFile ? fopen(path, format_ == RESULT_BINARY ? "wb" : "w") : stdout;
+    if (fp == NULL)
+        return false;
+    format = format_;
+    failed = false;
+    used = 0;
+    if (format == RESULT_BINARY) {
+        ResultFileHeader header;
+        memcpy(header.magic, RESULT_MAGIC, sizeof(header.magic));
+        header.version = RESULT_VERSION;
+        header.record_size = sizeof(ResultRecord);
+        append((const char *) &header, sizeof(header));
+    }
+    return true;
+}
+
+bool ResultWriter::write(const ResultInfo &info, const mtcnn_face *faces, int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fp == NULL)
+        return false;
+    if (info.error != NULL || faces == NULL || count < 0)
+        count = 0;
+    if (format == RESULT_BINARY)
+        writeBinary(info, faces, count);
+    else
+        writeJson(info, faces, count);
+    return !failed;
+}
+
+bool ResultWriter::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fp != NULL && flushLocked() && fflush(fp) == 0;
+}
+
+bool ResultWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fp == NULL)
+        return true;
+    bool ok = flushLocked();
+    if (ownsFile)
+        ok = fclose(fp) == 0 && ok;
+    else
+        ok = fflush(fp) == 0 && ok;
+    fp = NULL;
+    return ok;
+}
+
+bool ResultWriter::flushLocked() {
+    if (used > 0 && fwrite(buffer, 1, used, fp) != used)
+        failed = true;
+    used = 0;
+    return !failed;
+}
+
+bool ResultWriter::reserve(size_t size) {
+    if (used + size > sizeof(buffer))
+        flushLocked();
+    return size <= sizeof(buffer);
+}
+
+void ResultWriter::append(const char *s, size_t size) {
+    while (size > 0) {
+        reserve(size < sizeof(buffer) ? size : sizeof(buffer));
+        size_t n = sizeof(buffer) - used < size ? sizeof(buffer) - used : size;
+        memcpy(buffer + used, s, n);
+        used += n;
+        s += n;
+        size -= n;
+    }
+}
+
+void ResultWriter::appendString(const char *s) {
+    append(s, strlen(s));
+}
+
+void ResultWriter::appendQuoted(const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    reserve(1);
+    buffer[used++] = '"';
+    for (; *s; s++) {
+        reserve(6);
+        const unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            buffer[used++] = '\\';
+            buffer[used++] = (char) c;
+        } else if (c < 0x20) {
+            memcpy(buffer + used, "\\u00", 4);
+            buffer[used + 4] = hex[c >> 4];
+            buffer[used + 5] = hex[c & 15];
+            used += 6;
+        } else {
+            buffer[used++] = (char) c;
+        }
+    }
+    reserve(1);
+    buffer[used++] = '"';
+}
+
+void ResultWriter::appendInt(int64_t v) {
+    char digits[24];
+    int n = 0;
+    uint64_t u = v < 0 ? 0 - (uint64_t) v : (uint64_t) v;
+    do {
+        digits[n++] = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    reserve(n + 1);
+    if (v < 0)
+        buffer[used++] = '-';
+    while (n > 0)
+        buffer[used++] = digits[--n];
+}
+
+// fixed point with decimals <= 6 digits after the dot, like printf %.Nf
+void ResultWriter::appendFixed(double v, int decimals) {
+    static const int64_t scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if (!(v == v))
+        v = 0;
+    const bool negative = v < 0;
+    const int64_t scaled = (int64_t) ((negative ? -v : v) * scale[decimals] + 0.5);
+    if (negative && scaled != 0) {
+        reserve(1);
+        buffer[used++] = '-';
+    }
+    appendInt(scaled / scale[decimals]);
+    if (decimals == 0)
+        return;
+    reserve(decimals + 1);
+    buffer[used++] = '.';
+    int64_t frac = scaled % scale[decimals];
+    for (int i = decimals - 1; i >= 0; i--) {
+        buffer[used + i] = (char) ('0' + frac % 10);
+        frac /= 10;
+    }
+    used += decimals;
+}
+
+void ResultWriter::writeJson(const ResultInfo &info, const mtcnn_face *faces, int count) {
+    const char *sep = "{";
+    if (info.image) {
+        appendString("{\"image\": ");
+        appendQuoted(info.image);
+        sep = ", ";
+    }
+    if (info.index >= 0 && info.image == NULL) {
+        appendString(sep);
+        appendString("\"frame\": ");
+        appendInt(info.index);
+        sep = ", ";
+    }
+    if (info.output) {
+        appendString(sep);
+        appendString("\"output\": ");
+        appendQuoted(info.output);
+        sep = ", ";
+    }
+    if (info.time >= 0) {
+        appendString(sep);
+        appendString("\"time\": ");
+        appendFixed(info.time, 3);
+        sep = ", ";
+    }
+    if (info.error) {
+        appendString(sep);
+        appendString("\"error\": ");
+        appendQuoted(info.error);
+        appendString("}\n");
+        return;
+    }
+    appendString(sep);
+    appendString("\"width\": ");
+    appendInt(info.width);
+    appendString(", \"height\": ");
+    appendInt(info.height);
+    appendString(", \"detect_ms\": ");
+    appendFixed(info.detect_ms, 2);
+    appendString(", \"faces\": [");
+    for (int i = 0; i < count; i++) {
+        const mtcnn_face &f = faces[i];
+        appendString(i ? ", {\"score\": " : "{\"score\": ");
+        appendFixed(f.score, 4);
+        appendString(", \"box\": [");
+        appendInt(f.x1);
+        appendString(", ");
+        appendInt(f.y1);
+        appendString(", ");
+        appendInt(f.x2);
+        appendString(", ");
+        appendInt(f.y2);
+        appendString("], \"landmarks\": [");
+        for (int k = 0; k < 5; k++) {
+            appendString(k ? ", [" : "[");
+            appendFixed(f.landmarks[k], 1);
+            appendString(", ");
+            appendFixed(f.landmarks[k + 5], 1);
+            appendString("]");
+        }
+        appendString("]}");
+    }
+    appendString("]}\n");
+}
+
+void ResultWriter::writeBinary(const ResultInfo &info, const mtcnn_face *faces, int count) {
+    ResultRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = RESULT_RECORD_IMAGE;
+    record.count = (uint32_t) count;
+    record.index = info.index;
+    record.image.width = info.width;
+    record.image.height = info.height;
+    record.image.detect_ms = (float) info.detect_ms;
+    record.image.status = info.error ? -1 : 0;
+    append((const char *) &record, sizeof(record));
+    for (int i = 0; i < count; i++) {
+        memset(&record, 0, sizeof(record));
+        record.type = RESULT_RECORD_FACE;
+        record.count = (uint32_t) i;
+        record.index = info.index;
+        record.face.score = faces[i].score;
+        record.face.x1 = faces[i].x1;
+        record.face.y1 = faces[i].y1;
+        record.face.x2 = faces[i].x2;
+        record.face.y2 = faces[i].y2;
+        memcpy(record.face.landmarks, faces[i].landmarks, sizeof(record.face.landmarks));
+        append((const char *) &record, sizeof(record));
+    }
+}
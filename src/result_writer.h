@@ -0,0 +1,128 @@
+#pragma once
+
+#ifndef __MTCNN_RESULT_WRITER_H__
+#define __MTCNN_RESULT_WRITER_H__
+
+#include "mtcnn_c.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+
+// Detection results as JSON lines or fixed size binary records, shared by the
+// demo's single image and batch modes and mtcnn_stream. Records are formatted
+// straight into one fixed buffer (no allocation, no printf) that is written
+// out when full, on flush() and on close().
+
+enum ResultFormat {
+    // {"image": ..., "frame": ..., "output": ..., "time": ..., "width": ..., "height": ...,
+    //  "detect_ms": ..., "faces": [{"score": ..., "box": [x1, y1, x2, y2],
+    //  "landmarks": [[x, y] x 5]}]}, keys without a value are left out
+    RESULT_JSON,
+    // ResultFileHeader, then per image one ResultRecord of type
+    // RESULT_RECORD_IMAGE followed by count records of type RESULT_RECORD_FACE
+    RESULT_BINARY
+};
+
+#define RESULT_MAGIC "MTCNNRES"
+#define RESULT_VERSION 1
+
+enum ResultRecordType {
+    RESULT_RECORD_IMAGE = 1,
+    RESULT_RECORD_FACE = 2
+};
+
+struct ResultFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+// little endian on every supported target, 80 bytes
+struct ResultRecord {
+    uint32_t type;
+    // image: number of face records that follow, face: position within the image
+    uint32_t count;
+    // input position in batch mode, frame number in stream mode
+    int64_t index;
+    union {
+        struct {
+            int32_t width, height;
+            float detect_ms;
+            // 0, or -1 if the image could not be read or detected
+            int32_t status;
+        } image;
+        struct {
+            float score;
+            int32_t x1, y1, x2, y2;
+            float landmarks[10];
+        } face;
+    };
+    uint32_t reserved;
+};
+
+struct ResultInfo {
+    const char *image = NULL;
+    int64_t index = -1;
+    // name the annotated image and face chips of a batch input are written under
+    const char *output = NULL;
+    // seconds from the start of a stream, < 0 if unknown
+    double time = -1;
+    int width = 0, height = 0;
+    double detect_ms = 0;
+    // set when the image failed, faces are ignored then
+    const char *error = NULL;
+};
+
+// "json" or "binary"
+bool parseResultFormat(const char *name, ResultFormat &format);
+
+class ResultWriter {
+public:
+    ResultWriter() {}
+
+    ~ResultWriter();
+
+    // "-" writes to stdout
+    bool open(const char *path, ResultFormat format);
+
+    // thread safe, records of one call are never interleaved with another
+    bool write(const ResultInfo &info, const mtcnn_face *faces, int count);
+
+    bool flush();
+
+    bool close();
+
+private:
+    ResultWriter(const ResultWriter &);
+
+    ResultWriter &operator=(const ResultWriter &);
+
+    // makes room for size bytes, writing the buffer out if needed
+    bool reserve(size_t size);
+
+    void append(const char *s, size_t size);
+
+    void appendString(const char *s);
+
+    void appendQuoted(const char *s);
+
+    void appendInt(int64_t v);
+
+    void appendFixed(double v, int decimals);
+
+    bool flushLocked();
+
+    void writeJson(const ResultInfo &info, const mtcnn_face *faces, int count);
+
+    void writeBinary(const ResultInfo &info, const mtcnn_face *faces, int count);
+
+    FILE *fp = NULL;
+    bool ownsFile = false;
+    bool failed = false;
+    ResultFormat format = RESULT_JSON;
+    size_t used = 0;
+    char buffer[1 << 16];
+    std::mutex mutex;
+};
+
+#endif //__MTCNN_RESULT_WRITER_H__
@@ -0,0 +1,255 @@
+#include "ronet_fused.h"
+#include "fused_kernels.h"
+#include "mat.h"
+#include "pixel_convert.h"
+#include "trace.h"
+#include <math.h>
+
+// crops per InnerProduct batch
+static const int BATCH = 16;
+
+static constexpr int cmax(int a, int b) {
+    return a > b ? a : b;
+}
+
+#if defined(PIXEL_AVX2)
+// fp16 to fp32, 8 at a time; every AVX2 CPU also has F16C, so pixelIsa() gates it
+__attribute__((target("avx2,f16c"))) static void widenF16c(const unsigned short *src, float *dst, int n) {
+    for (int i = 0; i < n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + i))));
+}
+#endif
+
+// InnerProduct (+ PReLU) over a batch of channel-interleaved inputs, weights [OUT][IN]
+template<int IN, int OUT>
+struct FCStage {
+    std::vector<float> w;
+    std::vector<unsigned short> w16;
+    float b[OUT], a[OUT];
+
+    // a hidden layer fed by a c x h x w map, ncnn flattens it planar
+    bool load(const ModelFile &model, const char *name, const char *prelu, int c, int h, int wd) {
+        const ModelLayer *layer = model.find(name);
+        if (layer == NULL || layer->type != "InnerProduct" || layer->storage == WEIGHT_INT8
+            || layer->numOutput() != OUT || (int) layer->weight.size() != OUT * IN || c * h * wd != IN
+            || (int) layer->bias.size() != OUT || !packPReLU(model, prelu, OUT, a))
+            return false;
+        std::vector<float> packed(OUT * IN);
+        for (int o = 0; o < OUT; o++) {
+            for (int q = 0; q < c; q++) {
+                for (int i = 0; i < h * wd; i++)
+                    packed[o * IN + i * c + q] = layer->weight[o * IN + q * h * wd + i];
+            }
+            b[o] = layer->bias[o];
+        }
+        w.clear();
+        w16.clear();
+        if (layer->storage == WEIGHT_FP16) {
+            w16.resize(packed.size());
+            for (size_t i = 0; i < packed.size(); i++)
+                w16[i] = ncnn::float32_to_float16(packed[i]);
+        } else {
+            w.swap(packed);
+        }
+        return true;
+    }
+
+    // output heads concatenated in order, no activation
+    bool loadHeads(const ModelFile &model, const char *const *names, int count) {
+        w.assign(OUT * IN, 0.f);
+        w16.clear();
+        int o = 0;
+        for (int n = 0; n < count; n++) {
+            const ModelLayer *layer = model.find(names[n]);
+            if (layer == NULL || layer->type != "InnerProduct" || layer->storage == WEIGHT_INT8
+                || (int) layer->weight.size() != layer->numOutput() * IN
+                || (int) layer->bias.size() != layer->numOutput() || o + layer->numOutput() > OUT)
+                return false;
+            for (int k = 0; k < layer->numOutput(); k++, o++) {
+                memcpy(&w[o * IN], &layer->weight[k * IN], IN * sizeof(float));
+                b[o] = layer->bias[k];
+                a[o] = 1.f;
+            }
+        }
+        return o == OUT;
+    }
+
+    void forward(const float *in, int n, float *out) const {
+        float row[IN];
+        for (int o = 0; o < OUT; o++) {
+            const float *wr = w16.empty() ? &w[o * IN] : widen(&w16[o * IN], row);
+            for (int k = 0; k < n; k++) {
+                const float *x = in + k * IN;
+                float sum = 0.f;
+                for (int i = 0; i < IN; i++)
+                    sum += wr[i] * x[i];
+                sum += b[o];
+                out[k * OUT + o] = sum < 0.f ? sum * a[o] : sum;
+            }
+        }
+    }
+
+    static const float *widen(const unsigned short *src, float *dst) {
+        int i = 0;
+#if defined(PIXEL_AVX2)
+        if (pixelIsa() == PIXEL_ISA_AVX2) {
+            i = IN & ~7;
+            widenF16c(src, dst, i);
+        }
+#endif
+        for (; i < IN; i++)
+            dst[i] = ncnn::float16_to_float32(src[i]);
+        return dst;
+    }
+};
+
+static void toInterleaved(const ncnn::Mat &crop, float *dst) {
+    const int size = crop.w * crop.h;
+    for (int q = 0; q < crop.c; q++) {
+        const float *src = crop.channel(q);
+        for (int i = 0; i < size; i++)
+            dst[i * crop.c + q] = src[i];
+    }
+}
+
+static void softmax2(float *p) {
+    const float m = std::max(p[0], p[1]);
+    const float e0 = expf(p[0] - m);
+    const float e1 = expf(p[1] - m);
+    p[0] = e0 / (e0 + e1);
+    p[1] = e1 / (e0 + e1);
+}
+
+template<class W>
+static void forwardBatched(const W &weights, const char *name, const std::vector<ncnn::Mat> &crops,
+                           std::vector<float> &out) {
+    const int n = (int) crops.size();
+    out.resize(n * W::OUT_DIM);
+    const int batches = (n + BATCH - 1) / BATCH;
+#pragma omp parallel for schedule(dynamic)
+    for (int batch = 0; batch < batches; batch++) {
+        // kept per thread between batches and calls, so the OpenMP team stays off the heap
+        static thread_local std::vector<float> scratch;
+        scratch.assign(W::SCRATCH_SIZE, 0.f);
+        const int begin = batch * BATCH;
+        TRACE_SCOPE(name, "batch", batch, "crops", std::min(BATCH, n - begin));
+        weights.forward(&crops[begin], std::min(BATCH, n - begin), &out[begin * W::OUT_DIM], scratch.data());
+    }
+}
+
+struct FusedRNet::Weights {
+    typedef ConvStage<3, 28, 3, 24, 24, 3, 2> Conv1;
+    typedef ConvStage<28, 48, 3, 11, 11, 3, 2> Conv2;
+    typedef ConvStage<48, 64, 2, 4, 4, 1, 1> Conv3;
+    static_assert(Conv1::OH == 11 && Conv2::OH == 4 && Conv3::OH == 3, "det2 shapes");
+
+    static const int OUT_DIM = FusedRNet::OUT_DIM;
+    static const int MAP_SIZE = cmax(Conv1::IN_SIZE, Conv1::OUT_SIZE);
+    static const int RING_SIZE = cmax(Conv1::SCRATCH_SIZE, Conv2::SCRATCH_SIZE);
+    static const int SCRATCH_SIZE = 2 * MAP_SIZE + RING_SIZE + BATCH * (Conv3::OUT_SIZE + 128);
+
+    Conv1 conv1;
+    Conv2 conv2;
+    Conv3 conv3;
+    FCStage<Conv3::OUT_SIZE, 128> conv4;
+    FCStage<128, OUT_DIM> heads;
+
+    bool load(const ModelFile &model) {
+        static const char *const names[] = {"conv5-1", "conv5-2"};
+        return conv1.load(model, "conv1", "prelu1") && conv2.load(model, "conv2", "prelu2")
+               && conv3.load(model, "conv3", "prelu3") && conv4.load(model, "conv4", "prelu4", 64, 3, 3)
+               && heads.loadHeads(model, names, 2);
+    }
+
+    void forward(const ncnn::Mat *crops, int n, float *out, float *scratch) const {
+        float *map_a = scratch;
+        float *map_b = map_a + MAP_SIZE;
+        float *ring = map_b + MAP_SIZE;
+        float *flat = ring + RING_SIZE;
+        float *hidden = flat + BATCH * Conv3::OUT_SIZE;
+        for (int k = 0; k < n; k++) {
+            toInterleaved(crops[k], map_a);
+            conv1.forward(map_a, map_b, ring);
+            conv2.forward(map_b, map_a, ring);
+            conv3.forward(map_a, flat + k * Conv3::OUT_SIZE, ring);
+        }
+        conv4.forward(flat, n, hidden);
+        heads.forward(hidden, n, out);
+        for (int k = 0; k < n; k++)
+            softmax2(out + k * OUT_DIM);
+    }
+};
+
+struct FusedONet::Weights {
+    typedef ConvStage<3, 32, 3, 48, 48, 3, 2> Conv1;
+    typedef ConvStage<32, 64, 3, 23, 23, 3, 2> Conv2;
+    typedef ConvStage<64, 64, 3, 10, 10, 2, 2> Conv3;
+    typedef ConvStage<64, 128, 2, 4, 4, 1, 1> Conv4;
+    static_assert(Conv1::OH == 23 && Conv2::OH == 10 && Conv3::OH == 4 && Conv4::OH == 3, "det3 shapes");
+
+    static const int OUT_DIM = FusedONet::OUT_DIM;
+    static const int MAP_SIZE = cmax(Conv1::IN_SIZE, Conv1::OUT_SIZE);
+    static const int RING_SIZE = cmax(Conv1::SCRATCH_SIZE, cmax(Conv2::SCRATCH_SIZE, Conv3::SCRATCH_SIZE));
+    static const int SCRATCH_SIZE = 2 * MAP_SIZE + RING_SIZE + BATCH * (Conv4::OUT_SIZE + 256);
+
+    Conv1 conv1;
+    Conv2 conv2;
+    Conv3 conv3;
+    Conv4 conv4;
+    FCStage<Conv4::OUT_SIZE, 256> conv5;
+    FCStage<256, OUT_DIM> heads;
+
+    bool load(const ModelFile &model) {
+        static const char *const names[] = {"conv6-1", "conv6-2", "conv6-3"};
+        return conv1.load(model, "conv1", "prelu1") && conv2.load(model, "conv2", "prelu2")
+               && conv3.load(model, "conv3", "prelu3") && conv4.load(model, "conv4", "prelu4")
+               && conv5.load(model, "conv5", "prelu5", 128, 3, 3) && heads.loadHeads(model, names, 3);
+    }
+
+    void forward(const ncnn::Mat *crops, int n, float *out, float *scratch) const {
+        float *map_a = scratch;
+        float *map_b = map_a + MAP_SIZE;
+        float *ring = map_b + MAP_SIZE;
+        float *flat = ring + RING_SIZE;
+        float *hidden = flat + BATCH * Conv4::OUT_SIZE;
+        for (int k = 0; k < n; k++) {
+            toInterleaved(crops[k], map_a);
+            conv1.forward(map_a, map_b, ring);
+            conv2.forward(map_b, map_a, ring);
+            conv3.forward(map_a, map_b, ring);
+            conv4.forward(map_b, flat + k * Conv4::OUT_SIZE, ring);
+        }
+        conv5.forward(flat, n, hidden);
+        heads.forward(hidden, n, out);
+        for (int k = 0; k < n; k++)
+            softmax2(out + k * OUT_DIM);
+    }
+};
+
+FusedRNet::FusedRNet() : weights(new Weights) {
+}
+
+FusedRNet::~FusedRNet() {
+}
+
+bool FusedRNet::load(const ModelFile &model) {
+    return weights->load(model);
+}
+
+void FusedRNet::forward(const std::vector<ncnn::Mat> &crops, std::vector<float> &out) const {
+    forwardBatched(*weights, "rnet_batch", crops, out);
+}
+
+FusedONet::FusedONet() : weights(new Weights) {
+}
+
+FusedONet::~FusedONet() {
+}
+
+bool FusedONet::load(const ModelFile &model) {
+    return weights->load(model);
+}
+
+void FusedONet::forward(const std::vector<ncnn::Mat> &crops, std::vector<float> &out) const {
+    forwardBatched(*weights, "onet_batch", crops, out);
+}
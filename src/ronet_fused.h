@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef __MTCNN_RONET_FUSED_H__
+#define __MTCNN_RONET_FUSED_H__
+
+#include "net.h"
+#include "ncnn_model.h"
+#include <memory>
+#include <vector>
+
+// Fixed-shape RNet (det2.param, 3x24x24) and ONet (det3.param, 3x48x48).
+// Every layer shape is a template constant, conv/PReLU/pool run as one pass
+// per crop and the InnerProduct layers run over batches of crops so each
+// weight row is read once per batch. fp16 models keep the large
+// InnerProduct weights in half precision and widen them per row.
+
+class FusedRNet {
+public:
+    static const int SIZE = 24;
+    // 2 probabilities, 4 box offsets
+    static const int OUT_DIM = 6;
+
+    FusedRNet();
+
+    ~FusedRNet();
+
+    bool load(const ModelFile &model);
+
+    // crops are 3 x 24 x 24, out receives crops.size() * OUT_DIM values
+    void forward(const std::vector<ncnn::Mat> &crops, std::vector<float> &out) const;
+
+    struct Weights;
+private:
+    std::unique_ptr<Weights> weights;
+};
+
+class FusedONet {
+public:
+    static const int SIZE = 48;
+    // 2 probabilities, 4 box offsets, 10 landmark coordinates
+    static const int OUT_DIM = 16;
+
+    FusedONet();
+
+    ~FusedONet();
+
+    bool load(const ModelFile &model);
+
+    // crops are 3 x 48 x 48, out receives crops.size() * OUT_DIM values
+    void forward(const std::vector<ncnn::Mat> &crops, std::vector<float> &out) const;
+
+    struct Weights;
+private:
+    std::unique_ptr<Weights> weights;
+};
+
+#endif //__MTCNN_RONET_FUSED_H__
@@ -0,0 +1,152 @@
+#include "thread_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#if defined(__linux__)
+static std::vector<int> currentCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// taken during static initialization, before any detector pins a thread
+static const std::vector<int> startupCpus = currentCpus();
+#endif
+
+bool parseCpuList(const std::string &list, std::vector<int> &cpus) {
+    cpus.clear();
+    const char *p = list.c_str();
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back((int) cpu);
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n')
+            return false;
+        else
+            break;
+    }
+    return !cpus.empty();
+}
+
+bool numaNodeCpus(int node, std::vector<int> &cpus) {
+    cpus.clear();
+#if defined(__linux__)
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return false;
+    char line[4096];
+    bool ok = fgets(line, sizeof(line), fp) != NULL && parseCpuList(line, cpus);
+    fclose(fp);
+    return ok;
+#else
+    (void) node;
+    return false;
+#endif
+}
+
+int numaNodeCount() {
+    int count = 0;
+    while (count < 1024) {
+#if defined(__linux__)
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", count);
+        if (access(path, F_OK) != 0)
+            break;
+        count++;
+#else
+        break;
+#endif
+    }
+    return count > 0 ? count : 1;
+}
+
+bool setThreadAffinity(const std::vector<int> &cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    if (CPU_COUNT(&set) == 0)
+        return false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpus;
+    return false;
+#endif
+}
+
+bool setThreadNumaNode(int node) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    if (node < 0)
+        return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0) == 0;
+    if (node >= 1024)
+        return false;
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {0};
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, 1024) == 0;
+#else
+    (void) node;
+    return false;
+#endif
+}
+
+bool restoreThreadPlacement() {
+#if defined(__linux__)
+    const bool pinned = startupCpus.empty() || setThreadAffinity(startupCpus);
+    return setThreadNumaNode(-1) && pinned;
+#else
+    return false;
+#endif
+}
+
+bool getThreadMemoryPolicy(MemoryPolicy &policy) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    policy = MemoryPolicy();
+    return syscall(SYS_get_mempolicy, &policy.mode, policy.nodes, 1024, NULL, 0) == 0;
+#else
+    (void) policy;
+    return false;
+#endif
+}
+
+bool setThreadMemoryPolicy(const MemoryPolicy &policy) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    // mode carries the MPOL_F_* flags get_mempolicy reported, set_mempolicy takes them the same way
+    return syscall(SYS_set_mempolicy, policy.mode, policy.mode == MPOL_DEFAULT ? NULL : policy.nodes, 1024) == 0;
+#else
+    (void) policy;
+    return false;
+#endif
+}
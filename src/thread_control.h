@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef __MTCNN_THREAD_CONTROL_H__
+#define __MTCNN_THREAD_CONTROL_H__
+
+#include <string>
+#include <vector>
+
+// CPU affinity and NUMA memory placement of the calling thread. Linux only,
+// everywhere else the calls do nothing and return false.
+
+// "0-3,8,10-11" -> 0 1 2 3 8 10 11, false on a malformed list
+bool parseCpuList(const std::string &list, std::vector<int> &cpus);
+
+// CPUs of a NUMA node, read from sysfs
+bool numaNodeCpus(int node, std::vector<int> &cpus);
+
+// number of configured NUMA nodes, 1 when unknown
+int numaNodeCount();
+
+// restricts the calling thread to cpus; threads it creates afterwards inherit the mask
+bool setThreadAffinity(const std::vector<int> &cpus);
+
+// memory the calling thread touches first is placed on node when it has
+// room (MPOL_PREFERRED), node < 0 restores the default policy; inherited by
+// threads it creates afterwards
+bool setThreadNumaNode(int node);
+
+// back to the affinity mask the process started with and the default memory policy
+bool restoreThreadPlacement();
+
+// a thread's set_mempolicy mode and node mask, for putting it back after a
+// temporary setThreadNumaNode
+struct MemoryPolicy {
+    int mode = 0;
+    unsigned long nodes[1024 / (8 * sizeof(unsigned long))] = {0};
+};
+
+bool getThreadMemoryPolicy(MemoryPolicy &policy);
+
+bool setThreadMemoryPolicy(const MemoryPolicy &policy);
+
+#endif //__MTCNN_THREAD_CONTROL_H__
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef __MTCNN_TOOL_UTILS_H__
+#define __MTCNN_TOOL_UTILS_H__
+
+// Small helpers shared by the command line tools. Header only, like timing.h.
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+// nearest rank percentile, p in 0..100, of samples sorted ascending
+static inline double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t) ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// whole file, data is left empty on failure
+static inline bool readFile(const char *file, std::vector<unsigned char> &data) {
+    data.clear();
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    if (!ok)
+        data.clear();
+    return ok;
+}
+
+#endif //__MTCNN_TOOL_UTILS_H__
@@ -0,0 +1,142 @@
+#include "trace.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TraceEvent {
+    const char *name;
+    const char *keys[2];
+    int values[2];
+    int64_t begin, end;
+};
+
+struct TraceBuffer {
+    int tid;
+    std::vector<TraceEvent> events;
+};
+
+// events kept per thread, later ones are counted in droppedEvents
+static const size_t maxThreadEvents = 1 << 18;
+
+static std::atomic<bool> enabled(false);
+// scopes that may still append to their buffer
+static std::atomic<int> inFlight(0);
+static std::atomic<size_t> droppedEvents(0);
+static std::mutex registryLock;
+// buffers outlive their threads so short-lived workers still show up
+static std::vector<std::shared_ptr<TraceBuffer> > registry;
+
+static int64_t traceNow() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static TraceBuffer *localBuffer() {
+    thread_local std::shared_ptr<TraceBuffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<TraceBuffer>();
+        std::lock_guard<std::mutex> guard(registryLock);
+        buffer->tid = (int) registry.size();
+        registry.push_back(buffer);
+    }
+    return buffer.get();
+}
+
+void traceEnable(bool enable) {
+    if (enable)
+        traceNow();
+    enabled = enable;
+}
+
+bool traceEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+// Recording is paused and the scopes already recording are waited for, so
+// the buffers are only read while no thread appends to them. A scope checks
+// enabled after counting itself in inFlight, once the pause is seen no new
+// scope can slip in.
+class TracePause {
+public:
+    TracePause() : guard(registryLock), resume(enabled.exchange(false)) {
+        while (inFlight.load() > 0)
+            std::this_thread::yield();
+    }
+
+    ~TracePause() {
+        enabled = resume;
+    }
+
+private:
+    std::lock_guard<std::mutex> guard;
+    bool resume;
+};
+
+void traceClear() {
+    TracePause pause;
+    for (auto &buffer : registry)
+        std::vector<TraceEvent>().swap(buffer->events);
+    droppedEvents = 0;
+}
+
+bool traceWrite(const char *filename) {
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL)
+        return false;
+    TracePause pause;
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": %zu}, \"traceEvents\": [\n",
+            droppedEvents.load());
+    bool first = true;
+    for (const auto &buffer : registry) {
+        fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                    "\"args\": {\"name\": \"thread %d\"}}", first ? "" : ",\n", buffer->tid, buffer->tid);
+        first = false;
+        for (const auto &e : buffer->events) {
+            fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    e.name, buffer->tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+            if (e.keys[0]) {
+                fprintf(fp, ", \"args\": {\"%s\": %d", e.keys[0], e.values[0]);
+                if (e.keys[1])
+                    fprintf(fp, ", \"%s\": %d", e.keys[1], e.values[1]);
+                fprintf(fp, "}");
+            }
+            fprintf(fp, "}");
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
+
+TraceScope::TraceScope(const char *name, const char *key0, int value0, const char *key1, int value1)
+        : name(name), begin(-1) {
+    if (!traceEnabled())
+        return;
+    // registered before counting in, a paused writer holds registryLock
+    localBuffer();
+    inFlight++;
+    if (!enabled.load()) {
+        inFlight--;
+        return;
+    }
+    keys[0] = key0;
+    keys[1] = key1;
+    values[0] = value0;
+    values[1] = value1;
+    begin = traceNow();
+}
+
+TraceScope::~TraceScope() {
+    if (begin < 0)
+        return;
+    TraceEvent e = {name, {keys[0], keys[1]}, {values[0], values[1]}, begin, traceNow()};
+    std::vector<TraceEvent> &events = localBuffer()->events;
+    if (events.size() < maxThreadEvents)
+        events.push_back(e);
+    else
+        droppedEvents++;
+    inFlight--;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef __MTCNN_TRACE_H__
+#define __MTCNN_TRACE_H__
+
+#include <stdint.h>
+
+// Opt-in timeline tracing written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Every thread appends complete events to its own buffer without locking, the
+// buffers are only registered once per thread and merged by traceWrite().
+// A buffer keeps at most 2^18 events, the rest are dropped and counted.
+// Event names and argument keys must be string literals.
+
+void traceEnable(bool enable);
+
+bool traceEnabled();
+
+// traceClear and traceWrite pause recording and wait for the scopes still
+// open on other threads, so they must not be called inside a TRACE_SCOPE.
+// Scopes opened during the pause are not recorded.
+
+// drops all recorded events
+void traceClear();
+
+bool traceWrite(const char *filename);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, const char *key0 = 0, int value0 = 0,
+                        const char *key1 = 0, int value1 = 0);
+
+    ~TraceScope();
+
+private:
+    const char *name;
+    const char *keys[2];
+    int values[2];
+    int64_t begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// TRACE_SCOPE("nms", "boxes", n) records the enclosing block
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif //__MTCNN_TRACE_H__
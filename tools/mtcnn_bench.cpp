@@ -0,0 +1,453 @@
+// Per-stage microbenchmarks for the MTCNN cascade, reported as JSON.
+//
+//   mtcnn_bench <model_path> <face_source_image> [options]
+//     --sizes 640x480,1280x720,1920x1080   synthetic image sizes
+//     --minsizes 20,40,80                  minimum face sizes
+//     --faces 0,4,16                       faces pasted per synthetic image
+//     --threads 1,4                        OpenMP thread counts
+//     --nms-counts 100,1000,5000           candidate counts for the nms benchmark
+//     --warmup 3 --reps 20                 untimed and timed repetitions
+//     --fused --canvas                     optimized kernel / canvas modes
+//     --out bench.json                     default stdout
+//     --cold-starts 10                     first-call latency instead, see below
+//
+// Faces are cut from the detections in the source image and pasted at random
+// positions and sizes onto a noise background, with a fixed seed.
+//
+// --cold-starts N forks N fresh processes per mode that load the models and
+// time their first detect on the source image itself, once as is ("cold") and
+// once after MTCNN::warmup of the image size ("warm"); the second detect of
+// every process is reported as the steady state. It needs fork(), so it is
+// not built on Windows.
+
+#include "mtcnn.h"
+#include "timing.h"
+#include "tool_utils.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include <random>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+struct Options {
+    std::vector<std::pair<int, int> > sizes = {{640, 480}, {1280, 720}, {1920, 1080}};
+    std::vector<int> minsizes = {20, 40, 80};
+    std::vector<int> faces = {0, 4, 16};
+    std::vector<int> threads = {1};
+    std::vector<int> nms_counts = {100, 1000, 5000};
+    int warmup = 3;
+    int reps = 20;
+    bool fused = false;
+    bool canvas = false;
+    int cold_starts = 0;
+    std::string out;
+};
+
+struct Config {
+    int width, height, minsize, faces, threads;
+};
+
+struct FacePatch {
+    std::vector<unsigned char> pixels;
+    int w, h;
+};
+
+static std::vector<int> parseList(const char *s) {
+    std::vector<int> v;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        v.push_back(atoi(item.c_str()));
+    return v;
+}
+
+template<class Setup, class Run>
+static std::vector<double> measure(int warmup, int reps, Setup setup, Run run) {
+    std::vector<double> samples;
+    for (int i = 0; i < warmup + reps; i++) {
+        setup();
+        double start = now();
+        run();
+        double elapsed = calcElapsed(start, now());
+        if (i >= warmup)
+            samples.push_back(elapsed * 1000);
+    }
+    return samples;
+}
+
+class Report {
+public:
+    explicit Report(FILE *fp) : fp(fp), first(true) {}
+
+    void add(const char *stage, const Config &cfg, const std::string &extra, std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double s : samples)
+            sum += s;
+        fprintf(fp, "%s    {\"stage\": \"%s\", \"width\": %d, \"height\": %d, \"minsize\": %d, \"faces\": %d, "
+                    "\"threads\": %d%s, \"reps\": %d, \"mean_ms\": %.4f, \"min_ms\": %.4f, \"p50_ms\": %.4f, "
+                    "\"p90_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+                first ? "" : ",\n", stage, cfg.width, cfg.height, cfg.minsize, cfg.faces, cfg.threads,
+                extra.c_str(), (int) samples.size(), sum / std::max<size_t>(1, samples.size()),
+                samples.empty() ? 0 : samples.front(), percentile(samples, 50), percentile(samples, 90),
+                percentile(samples, 99), samples.empty() ? 0 : samples.back());
+        first = false;
+    }
+
+private:
+    FILE *fp;
+    bool first;
+};
+
+static std::vector<FacePatch> loadFaces(MTCNN &mtcnn, const char *file) {
+    std::vector<FacePatch> patches;
+    int w = 0, h = 0, c = 0;
+    unsigned char *pixels = stbi_load(file, &w, &h, &c, 3);
+    if (pixels == NULL) {
+        fprintf(stderr, "load %s failed, synthetic images will have no faces\n", file);
+        return patches;
+    }
+    ncnn::Mat img = ncnn::Mat::from_pixels(pixels, ncnn::Mat::PIXEL_RGB, w, h);
+    std::vector<Bbox> boxes;
+    mtcnn.detect(img, boxes);
+    for (const auto &box : boxes) {
+        // keep some context around the face so PNet sees a full window
+        int margin = (box.x2 - box.x1) / 5;
+        int x1 = std::max(0, box.x1 - margin), y1 = std::max(0, box.y1 - margin);
+        int x2 = std::min(w - 1, box.x2 + margin), y2 = std::min(h - 1, box.y2 + margin);
+        FacePatch patch;
+        patch.w = x2 - x1 + 1;
+        patch.h = y2 - y1 + 1;
+        patch.pixels.resize(patch.w * patch.h * 3);
+        for (int y = 0; y < patch.h; y++)
+            memcpy(&patch.pixels[y * patch.w * 3], pixels + ((y1 + y) * w + x1) * 3, patch.w * 3);
+        patches.push_back(patch);
+    }
+    stbi_image_free(pixels);
+    return patches;
+}
+
+// packed RGB
+static std::vector<unsigned char> makeImage(const Config &cfg, const std::vector<FacePatch> &patches) {
+    std::mt19937 rng(cfg.width * 31 + cfg.height * 17 + cfg.faces);
+    std::vector<unsigned char> pixels(cfg.width * cfg.height * 3);
+    std::uniform_int_distribution<int> noise(0, 31);
+    for (int y = 0; y < cfg.height; y++) {
+        for (int x = 0; x < cfg.width; x++) {
+            unsigned char *p = &pixels[(y * cfg.width + x) * 3];
+            p[0] = (unsigned char) (96 + x * 64 / cfg.width + noise(rng));
+            p[1] = (unsigned char) (96 + y * 64 / cfg.height + noise(rng));
+            p[2] = (unsigned char) (128 + noise(rng));
+        }
+    }
+    for (int i = 0; i < cfg.faces && !patches.empty(); i++) {
+        const FacePatch &patch = patches[i % patches.size()];
+        int size = std::uniform_int_distribution<int>(cfg.minsize, cfg.minsize * 3)(rng);
+        int pw = std::min(cfg.width, size);
+        int ph = std::min(cfg.height, size * patch.h / patch.w);
+        int px = std::uniform_int_distribution<int>(0, cfg.width - pw)(rng);
+        int py = std::uniform_int_distribution<int>(0, cfg.height - ph)(rng);
+        std::vector<unsigned char> resized(pw * ph * 3);
+        ncnn::resize_bilinear_c3(patch.pixels.data(), patch.w, patch.h, resized.data(), pw, ph);
+        for (int y = 0; y < ph; y++)
+            memcpy(&pixels[((py + y) * cfg.width + px) * 3], &resized[y * pw * 3], pw * 3);
+    }
+    return pixels;
+}
+
+static std::vector<Bbox> makeCandidates(int count, std::mt19937 &rng) {
+    // clustered like PNet output, a few hundred pixels wide
+    std::vector<Bbox> boxes(count);
+    std::uniform_int_distribution<int> center(0, 1500), jitter(-8, 8), size(20, 120);
+    std::uniform_real_distribution<float> score(0.6f, 1.0f);
+    int cx = 0, cy = 0, s = 0;
+    for (int i = 0; i < count; i++) {
+        if (i % 20 == 0) {
+            cx = center(rng);
+            cy = center(rng);
+            s = size(rng);
+        }
+        Bbox &b = boxes[i];
+        memset(&b, 0, sizeof(b));
+        b.x1 = cx + jitter(rng);
+        b.y1 = cy + jitter(rng);
+        b.x2 = b.x1 + s + jitter(rng);
+        b.y2 = b.y1 + s + jitter(rng);
+        b.area = (b.x2 - b.x1) * (b.y2 - b.y1);
+        b.score = score(rng);
+    }
+    return boxes;
+}
+
+static void setThreads(int threads) {
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#else
+    (void) threads;
+#endif
+}
+
+static void benchConfig(MTCNN &mtcnn, const Config &cfg, const Options &opt, const std::vector<FacePatch> &patches,
+                        Report &report) {
+    const std::vector<unsigned char> pixels = makeImage(cfg, patches);
+    const ImageView image = ImageView::fromPacked(pixels.data(), PIXEL_FORMAT_RGB, cfg.width, cfg.height);
+    mtcnn.SetMinFace(cfg.minsize);
+
+    std::vector<Bbox> faces;
+    report.add("detect", cfg, "", measure(opt.warmup, opt.reps, [&]() { faces.clear(); },
+                                          [&]() { mtcnn.detect(image, faces); }));
+
+    // the first call of a size builds the plan (levels, sampler coefficients,
+    // level buffers), later calls only sample
+    MTCNN::Stages stages(mtcnn);
+    stages.setImage(image);
+    const size_t count = stages.levels();
+    std::vector<ncnn::Mat> levels(count);
+    auto pyramid = [&]() {
+        for (size_t i = 0; i < count; i++)
+            levels[i] = stages.levelInput(i);
+    };
+    report.add("pyramid_first", cfg, ", \"levels\": " + std::to_string(count),
+               measure(opt.warmup, opt.reps, [&]() {
+                   levels.assign(count, ncnn::Mat());
+                   stages.dropPlans();
+               }, pyramid));
+    report.add("pyramid", cfg, ", \"levels\": " + std::to_string(count),
+               measure(opt.warmup, opt.reps, []() {}, pyramid));
+
+    std::vector<ncnn::Mat> scores(count), locations(count);
+    for (size_t i = 0; i < count; i++) {
+        std::string extra = ", \"level\": " + std::to_string(i) + ", \"level_width\": " +
+                            std::to_string(levels[i].w) + ", \"level_height\": " + std::to_string(levels[i].h);
+        report.add("pnet", cfg, extra, measure(opt.warmup, opt.reps, []() {}, [&]() {
+            stages.pnet(levels[i], scores[i], locations[i]);
+        }));
+    }
+
+    std::vector<Bbox> candidates;
+    report.add("generate_bbox", cfg, "", measure(opt.warmup, opt.reps, [&]() { candidates.clear(); }, [&]() {
+        for (size_t i = 0; i < count; i++)
+            stages.generateBbox(scores[i], locations[i], stages.levelScale(i), candidates);
+    }));
+
+    std::vector<Bbox> rnet_input = stages.rnetInput();
+    std::vector<Bbox> boxes;
+    report.add("refine", cfg, ", \"candidates\": " + std::to_string(rnet_input.size()),
+               measure(opt.warmup, opt.reps, [&]() { boxes = rnet_input; }, [&]() { stages.refine(boxes); }));
+    report.add("rnet", cfg, ", \"candidates\": " + std::to_string(rnet_input.size()),
+               measure(opt.warmup, opt.reps, []() {}, [&]() { stages.rnet(rnet_input); }));
+    std::vector<Bbox> onet_input = stages.onetInput(rnet_input);
+    report.add("onet", cfg, ", \"candidates\": " + std::to_string(onet_input.size()),
+               measure(opt.warmup, opt.reps, []() {}, [&]() { stages.onet(onet_input); }));
+}
+
+#ifndef _WIN32
+
+// load, warmup, first and second detect in ms, -1 for steps not run
+struct ColdStart {
+    double load, warmup, first, second;
+};
+
+static bool coldStart(const char *model_path, const unsigned char *pixels, int w, int h, const Options &opt,
+                      bool warm, ColdStart &result) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        ColdStart r = {-1, -1, -1, -1};
+        double start = now();
+        MTCNN mtcnn(model_path);
+        if (opt.fused) {
+            mtcnn.SetFusedPNet(true);
+            mtcnn.SetFusedRONet(true);
+        }
+        mtcnn.SetPyramidCanvas(opt.canvas);
+        r.load = calcElapsed(start, now()) * 1000;
+        if (warm) {
+            start = now();
+            mtcnn.warmup(w, h);
+            r.warmup = calcElapsed(start, now()) * 1000;
+        }
+        std::vector<Bbox> faces;
+        for (double *t : {&r.first, &r.second}) {
+            faces.clear();
+            start = now();
+            mtcnn.detect(pixels, PIXEL_FORMAT_RGB, w, h, 0, faces);
+            *t = calcElapsed(start, now()) * 1000;
+        }
+        bool ok = write(fds[1], &r, sizeof(r)) == (ssize_t) sizeof(r);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &result, sizeof(result)) == (ssize_t) sizeof(result);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// nothing is loaded in this process before the forks, every child starts from scratch
+static int benchColdStarts(const char *model_path, const char *image, const Options &opt, FILE *fp) {
+    int w = 0, h = 0, c = 0;
+    unsigned char *pixels = stbi_load(image, &w, &h, &c, 3);
+    if (pixels == NULL) {
+        fprintf(stderr, "load %s failed\n", image);
+        return -1;
+    }
+    setThreads(opt.threads.front());
+    fprintf(fp, "{\n  \"cold_starts\": %d,\n  \"fused\": %s,\n  \"canvas\": %s,\n  \"results\": [\n",
+            opt.cold_starts, opt.fused ? "true" : "false", opt.canvas ? "true" : "false");
+    Report report(fp);
+    Config cfg = {w, h, 40, 0, opt.threads.front()};
+    for (bool warm : {false, true}) {
+        std::vector<double> load, warmup, first, second;
+        for (int i = 0; i < opt.cold_starts; i++) {
+            ColdStart r;
+            if (!coldStart(model_path, pixels, w, h, opt, warm, r)) {
+                fprintf(stderr, "cold start %d failed\n", i);
+                continue;
+            }
+            load.push_back(r.load);
+            if (warm)
+                warmup.push_back(r.warmup);
+            first.push_back(r.first);
+            second.push_back(r.second);
+        }
+        const std::string mode = warm ? "warm" : "cold";
+        report.add(("load_" + mode).c_str(), cfg, "", load);
+        if (warm)
+            report.add("warmup", cfg, "", warmup);
+        report.add(("first_detect_" + mode).c_str(), cfg, "", first);
+        report.add(("second_detect_" + mode).c_str(), cfg, "", second);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    stbi_image_free(pixels);
+    return 0;
+}
+
+#endif
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("usage: %s model_path face_source_image [--sizes WxH,...] [--minsizes N,...] [--faces N,...]\n"
+               "       [--threads N,...] [--nms-counts N,...] [--warmup N] [--reps N] [--fused] [--canvas]"
+               " [--out file.json]\n"
+               "       [--cold-starts N]\n", argv[0]);
+        return 0;
+    }
+    Options opt;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--sizes" && has_value) {
+            opt.sizes.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                int w = 0, h = 0;
+                if (sscanf(item.c_str(), "%dx%d", &w, &h) == 2)
+                    opt.sizes.push_back(std::make_pair(w, h));
+            }
+        } else if (arg == "--minsizes" && has_value) {
+            opt.minsizes = parseList(argv[++i]);
+        } else if (arg == "--faces" && has_value) {
+            opt.faces = parseList(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            opt.threads = parseList(argv[++i]);
+        } else if (arg == "--nms-counts" && has_value) {
+            opt.nms_counts = parseList(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            opt.warmup = atoi(argv[++i]);
+        } else if (arg == "--reps" && has_value) {
+            opt.reps = atoi(argv[++i]);
+        } else if (arg == "--cold-starts" && has_value) {
+            opt.cold_starts = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--out" && has_value) {
+            opt.out = argv[++i];
+        } else if (arg == "--fused") {
+            opt.fused = true;
+        } else if (arg == "--canvas") {
+            opt.canvas = true;
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return -1;
+        }
+    }
+
+    if (opt.cold_starts > 0) {
+#ifdef _WIN32
+        fprintf(stderr, "--cold-starts needs fork(), not available on Windows\n");
+        return -1;
+#else
+        FILE *fp = opt.out.empty() ? stdout : fopen(opt.out.c_str(), "wb");
+        if (fp == NULL) {
+            fprintf(stderr, "open %s failed\n", opt.out.c_str());
+            return -1;
+        }
+        int ret = benchColdStarts(argv[1], argv[2], opt, fp);
+        if (fp != stdout)
+            fclose(fp);
+        return ret;
+#endif
+    }
+
+    MTCNN mtcnn(argv[1]);
+    std::vector<FacePatch> patches = loadFaces(mtcnn, argv[2]);
+    if (opt.fused && !(mtcnn.SetFusedPNet(true) && mtcnn.SetFusedRONet(true)))
+        fprintf(stderr, "fused kernels unavailable, benchmarking ncnn\n");
+    mtcnn.SetPyramidCanvas(opt.canvas);
+
+    FILE *fp = opt.out.empty() ? stdout : fopen(opt.out.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", opt.out.c_str());
+        return -1;
+    }
+    fprintf(fp, "{\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"fused\": %s,\n  \"canvas\": %s,\n"
+                "  \"face_patches\": %d,\n  \"results\": [\n",
+            opt.warmup, opt.reps, opt.fused ? "true" : "false", opt.canvas ? "true" : "false",
+            (int) patches.size());
+    Report report(fp);
+    MTCNN::Stages stages(mtcnn);
+    for (int threads : opt.threads) {
+        setThreads(threads);
+        std::mt19937 rng(threads);
+        for (int count : opt.nms_counts) {
+            const std::vector<Bbox> input = makeCandidates(count, rng);
+            std::vector<Bbox> boxes;
+            Config cfg = {0, 0, 0, 0, threads};
+            report.add("nms", cfg, ", \"candidates\": " + std::to_string(count),
+                       measure(opt.warmup, opt.reps, [&]() { boxes = input; },
+                               [&]() { stages.nms(boxes, 0.5f); }));
+        }
+        for (const auto &size : opt.sizes) {
+            for (int minsize : opt.minsizes) {
+                for (int faces : opt.faces) {
+                    Config cfg = {size.first, size.second, minsize, faces, threads};
+                    benchConfig(mtcnn, cfg, opt, patches, report);
+                }
+            }
+        }
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Sends images to mtcnn_daemon and prints the faces.
+//
+//   mtcnn_client <socket_path> <image>... [--min-face N] [--raw]
+//
+// Images are sent as encoded file bytes, --raw decodes them locally and sends RGB pixels.
+
+#include "daemon_protocol.h"
+#include "tool_utils.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("usage: %s socket_path image... [--min-face N] [--raw]\n", argv[0]);
+        return 0;
+    }
+    int min_face = 0;
+    bool raw = false;
+    std::vector<const char *> images;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--min-face" && i + 1 < argc)
+            min_face = atoi(argv[++i]);
+        else if (arg == "--raw")
+            raw = true;
+        else
+            images.push_back(argv[i]);
+    }
+    int fd = daemonConnect(argv[1]);
+    if (fd < 0) {
+        perror(argv[1]);
+        return -1;
+    }
+    int failures = 0;
+    for (const char *file : images) {
+        std::vector<unsigned char> payload;
+        int width = 0, height = 0;
+        if (raw) {
+            int channels = 0;
+            unsigned char *pixels = stbi_load(file, &width, &height, &channels, 3);
+            if (pixels)
+                payload.assign(pixels, pixels + width * height * 3);
+            stbi_image_free(pixels);
+        } else {
+            readFile(file, payload);
+        }
+        if (payload.empty()) {
+            fprintf(stderr, "read %s failed\n", file);
+            failures++;
+            continue;
+        }
+        DaemonResponse response;
+        std::vector<mtcnn_face> faces;
+        if (!daemonDetect(fd, raw ? DAEMON_RGB : DAEMON_ENCODED, payload.data(), (uint32_t) payload.size(), width,
+                          height, min_face, response, faces)) {
+            fprintf(stderr, "connection to %s lost\n", argv[1]);
+            close(fd);
+            return -1;
+        }
+        if (response.status != DAEMON_OK) {
+            fprintf(stderr, "%s: daemon status %d\n", file, response.status);
+            failures++;
+            continue;
+        }
+        printf("%s: %d faces, %.2f ms\n", file, (int) faces.size(), response.detect_ms);
+        for (const auto &f : faces) {
+            printf("  %d %d %d %d score %.4f landmarks", f.x1, f.y1, f.x2, f.y2, f.score);
+            for (int k = 0; k < 5; k++)
+                printf(" (%.1f, %.1f)", f.landmarks[k], f.landmarks[k + 5]);
+            printf("\n");
+        }
+    }
+    close(fd);
+    return failures ? 1 : 0;
+}
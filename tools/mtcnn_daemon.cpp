@@ -0,0 +1,353 @@
+// Detection daemon: loads the models once per worker and answers requests on a
+// Unix domain socket, see daemon_protocol.h for the framing.
+//
+//   mtcnn_daemon <model_path> <socket_path> [--workers 4] [--queue 64] [--min-face 40] [--fast]
+//                [--threads N] [--pin] [--numa-node N] [--warmup WxH] [--request-timeout 10]
+//
+// Every worker owns one detector and answers one request at a time. The main
+// thread polls all open connections and queues each one that has a request
+// waiting; the next free worker reads and answers that request and hands the
+// connection back. A client keeping its connection open between requests
+// therefore holds no worker. At most workers + --queue connections are open,
+// further ones are refused. A request not fully received within
+// --request-timeout seconds closes its connection. Workers split the cores
+// between them (--threads per worker), --pin gives each its own CPUs and
+// --numa-node keeps all of them on one node. With --warmup every worker runs
+// one detect of that size before the daemon reports it listens.
+
+#include "mtcnn_c.h"
+#include "daemon_protocol.h"
+#include "bounded_queue.h"
+#include "image_decode.h"
+#include "timing.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+static std::atomic<bool> stopping(false);
+// written to wake the poll() of the main thread
+static int wakeFds[2] = {-1, -1};
+
+static void wake() {
+    const char c = 0;
+    // a full pipe already wakes it
+    if (write(wakeFds[1], &c, 1) < 0) {}
+}
+
+static void onSignal(int) {
+    stopping = true;
+    wake();
+}
+
+// connections a worker is answering, shut down on exit so stalled clients do not block it
+class ActiveConnections {
+public:
+    void add(int fd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fds.insert(fd);
+    }
+
+    void remove(int fd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fds.erase(fd);
+    }
+
+    void shutdownAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int fd : fds)
+            shutdown(fd, SHUT_RDWR);
+    }
+
+private:
+    std::mutex mutex;
+    std::set<int> fds;
+};
+
+static bool reply(int fd, int status, float detect_ms, const mtcnn_face *faces, int count) {
+    DaemonResponse response = {DAEMON_MAGIC, status, (uint32_t) count, detect_ms};
+    return writeFull(fd, &response, sizeof(response)) && writeFull(fd, faces, count * sizeof(mtcnn_face));
+}
+
+// connections handed back by the workers, polled again by the main thread
+class IdleConnections {
+public:
+    void giveBack(int fd) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fds.push_back(fd);
+        }
+        wake();
+    }
+
+    void takeAll(std::vector<int> &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out.insert(out.end(), fds.begin(), fds.end());
+        fds.clear();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<int> fds;
+};
+
+// buffers of one worker, reused across requests
+struct WorkerBuffers {
+    std::vector<unsigned char> payload;
+    std::vector<mtcnn_face> faces = std::vector<mtcnn_face>(64);
+};
+
+// answers the one request waiting on fd, false when the connection is done
+static bool serveRequest(mtcnn_detector *detector, int fd, int default_min_face, WorkerBuffers &buffers) {
+    std::vector<unsigned char> &payload = buffers.payload;
+    std::vector<mtcnn_face> &faces = buffers.faces;
+    DaemonRequest request;
+    if (stopping || !readFull(fd, &request, sizeof(request)))
+        return false;
+    if (request.magic != DAEMON_MAGIC || request.version != DAEMON_VERSION || request.size > DAEMON_MAX_PAYLOAD) {
+        // the stream can not be resynchronized
+        reply(fd, DAEMON_BAD_REQUEST, 0.f, NULL, 0);
+        return false;
+    }
+    payload.resize(request.size);
+    if (!readFull(fd, payload.data(), payload.size()))
+        return false;
+
+    int width = request.width, height = request.height;
+    int min_face = request.min_face > 0 ? request.min_face : default_min_face;
+    DecodedImage decoded;
+    const unsigned char *rgb = payload.data();
+    int status = DAEMON_OK;
+    if (request.format == DAEMON_ENCODED) {
+        // JPEGs are decoded no larger than min_face needs
+        if (decodeImageMemory(payload.data(), payload.size(), min_face, decoded)) {
+            rgb = decoded.pixels;
+            width = decoded.width;
+            height = decoded.height;
+            min_face = decodedMinFace(decoded, min_face);
+        } else {
+            status = DAEMON_DECODE_FAILED;
+        }
+    } else if (request.format != DAEMON_RGB || width <= 0 || height <= 0
+               || (uint64_t) width * height * 3 != payload.size()) {
+        status = DAEMON_BAD_REQUEST;
+    }
+
+    int count = 0;
+    float detect_ms = 0.f;
+    if (status == DAEMON_OK) {
+        mtcnn_set_min_face(detector, min_face);
+        double start = now();
+        count = mtcnn_detect_rgb(detector, rgb, width, height, 0, faces.data(), (int) faces.size());
+        if (count > (int) faces.size()) {
+            faces.resize(count);
+            mtcnn_get_faces(detector, faces.data(), count);
+        }
+        detect_ms = (float) (calcElapsed(start, now()) * 1000);
+        if (count < 0) {
+            status = DAEMON_DETECT_FAILED;
+            count = 0;
+        }
+        mapFacesToFull(decoded, faces.data(), count);
+    }
+    freeImage(decoded);
+    return reply(fd, status, detect_ms, faces.data(), count);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("usage: %s model_path socket_path [--workers N] [--queue N] [--min-face N] [--fast]\n"
+               "       [--threads N] [--pin] [--numa-node N] [--warmup WxH] [--request-timeout S]\n", argv[0]);
+        return 0;
+    }
+    int workers = 4, queue_size = 64, min_face = 40, omp_threads = 0, numa_node = -1;
+    int warm_w = 0, warm_h = 0, request_timeout = 10;
+    bool fast = false, pin = false;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--workers" && has_value) {
+            workers = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--queue" && has_value) {
+            queue_size = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--min-face" && has_value) {
+            min_face = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            omp_threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--numa-node" && has_value) {
+            numa_node = atoi(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &warm_w, &warm_h) != 2 || warm_w <= 0 || warm_h <= 0) {
+                fprintf(stderr, "bad warmup size %s\n", argv[i]);
+                return -1;
+            }
+        } else if (arg == "--request-timeout" && has_value) {
+            request_timeout = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--pin") {
+            pin = true;
+        } else if (arg == "--fast") {
+            fast = true;
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return -1;
+        }
+    }
+
+    const int cores = std::max(1, (int) std::thread::hardware_concurrency());
+    if (omp_threads == 0)
+        omp_threads = std::max(1, cores / workers);
+    std::vector<mtcnn_detector *> detectors;
+    for (int i = 0; i < workers; i++) {
+        mtcnn_detector *detector = mtcnn_create(argv[1]);
+        if (detector == NULL) {
+            fprintf(stderr, "load models from %s failed\n", argv[1]);
+            return -1;
+        }
+        if (fast)
+            mtcnn_set_fast_path(detector, 1);
+        mtcnn_set_num_threads(detector, omp_threads);
+        if (numa_node >= 0 && !mtcnn_set_numa_node(detector, numa_node)) {
+            fprintf(stderr, "NUMA node %d is not available\n", numa_node);
+            return -1;
+        }
+        if (pin) {
+            std::string cpus;
+            for (int c = 0; c < omp_threads; c++)
+                cpus += (c ? "," : "") + std::to_string((i * omp_threads + c) % cores);
+            if (!mtcnn_set_cpu_affinity(detector, cpus.c_str()))
+                fprintf(stderr, "pinning worker %d to %s failed\n", i, cpus.c_str());
+        }
+        detectors.push_back(detector);
+    }
+
+    sockaddr_un addr;
+    if (!socketAddress(argv[2], addr)) {
+        fprintf(stderr, "socket path %s is too long\n", argv[2]);
+        return -1;
+    }
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(argv[2]);
+    if (listenFd < 0 || bind(listenFd, (const sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenFd, 128) != 0) {
+        perror(argv[2]);
+        return -1;
+    }
+    if (pipe(wakeFds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    for (int fd : wakeFds)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // connections with a request waiting, never more than are open
+    const int max_open = workers + queue_size;
+    BoundedQueue<int> pending(max_open);
+    ActiveConnections active;
+    IdleConnections handedBack;
+    std::atomic<int> open(0);
+    std::vector<std::thread> threads;
+    std::atomic<int> warming(workers);
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back([&, i]() {
+            // on the worker itself, its pinning and per-thread scratch are what gets warm
+            if (warm_w > 0)
+                mtcnn_warmup(detectors[i], warm_w, warm_h);
+            warming--;
+            WorkerBuffers buffers;
+            int fd;
+            while (pending.pop(fd)) {
+                active.add(fd);
+                const bool more = serveRequest(detectors[i], fd, min_face, buffers);
+                active.remove(fd);
+                if (more) {
+                    handedBack.giveBack(fd);
+                } else {
+                    close(fd);
+                    open--;
+                }
+            }
+        });
+    }
+    while (warming > 0 && !stopping)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    printf("listening on %s with %d workers\n", argv[2], workers);
+    fflush(stdout);
+    // connections between requests, polled here until their next one arrives
+    std::vector<int> idle;
+    std::vector<pollfd> polled;
+    const timeval timeout = {request_timeout, 0};
+    while (!stopping) {
+        polled.clear();
+        polled.push_back({listenFd, POLLIN, 0});
+        polled.push_back({wakeFds[0], POLLIN, 0});
+        for (int fd : idle)
+            polled.push_back({fd, POLLIN, 0});
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (polled[1].revents) {
+            char drain[64];
+            while (read(wakeFds[0], drain, sizeof(drain)) > 0) {}
+        }
+        // a readable connection has a request (or its end) waiting, a worker takes it from here
+        std::vector<int> still_idle;
+        for (size_t k = 2; k < polled.size(); k++) {
+            if (polled[k].revents)
+                pending.tryPush(polled[k].fd);
+            else
+                still_idle.push_back(polled[k].fd);
+        }
+        idle.swap(still_idle);
+        handedBack.takeAll(idle);
+        if (polled[0].revents & POLLIN) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0) {
+                if (errno != EINTR && errno != ECONNABORTED)
+                    break;
+            } else if (open >= max_open) {
+                fprintf(stderr, "%d connections open, refusing a new one\n", max_open);
+                close(fd);
+            } else {
+                // a client stalling inside a request does not keep its worker
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                open++;
+                idle.push_back(fd);
+            }
+        }
+    }
+
+    pending.close();
+    active.shutdownAll();
+    for (auto &thread : threads)
+        thread.join();
+    int fd;
+    while (pending.pop(fd))
+        close(fd);
+    handedBack.takeAll(idle);
+    for (int fd : idle)
+        close(fd);
+    close(listenFd);
+    unlink(argv[2]);
+    for (int i = 0; i < workers; i++) {
+        mtcnn_pool_stats pools;
+        if (mtcnn_get_pool_stats(detectors[i], &pools) && pools.requests > 0)
+            printf("worker %d: %.1f%% of %zu allocations reused from its pools\n", i,
+                   100.0 * pools.hits / pools.requests, pools.requests);
+        mtcnn_destroy(detectors[i]);
+    }
+    return 0;
+}
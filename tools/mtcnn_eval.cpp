@@ -0,0 +1,322 @@
+// Offline accuracy vs speed evaluation on a local annotated image set.
+//
+//   mtcnn_eval <model_path> <image_root> <annotation_file> [options]
+//     --format wider|fddb           wider_face_bbx_gt.txt or FDDB-fold-*-ellipseList.txt (default wider)
+//     --minsizes 20,40              minimum face sizes to sweep
+//     --factors 0.709               pyramid scale factors to sweep
+//     --pnet-thresholds 0.8         PNet score thresholds to sweep
+//     --thresholds 0.8,0.8,0.6      base P/R/O-Net thresholds
+//     --iou 0.5                     match threshold
+//     --min-face 0                  ground truth narrower than this is treated as don't care
+//     --limit N                     only the first N images
+//     --fused                       fused P/R/O-Net kernels
+//     --csv curve.csv               one row per configuration
+//
+// Every combination of the swept values is evaluated on the same decoded
+// images. Precision/recall are at the configured thresholds, AP is the area
+// under the all-point interpolated precision/recall curve over the detection scores.
+
+#include "mtcnn.h"
+#include "timing.h"
+#include "tool_utils.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+struct GroundTruth {
+    float x1, y1, x2, y2;
+    // WIDER invalid faces and faces under --min-face neither count as misses nor as false positives
+    bool ignore;
+};
+
+struct Sample {
+    std::string file;
+    std::vector<GroundTruth> faces;
+};
+
+struct EvalConfig {
+    int minsize;
+    float factor;
+    float threshold[3];
+};
+
+struct EvalResult {
+    // score and true positive flag of every counted detection
+    std::vector<std::pair<float, bool> > detections;
+    int positives = 0;
+    int true_pos = 0;
+    int false_pos = 0;
+    std::vector<double> latency;
+};
+
+static std::vector<float> parseFloats(const char *s) {
+    std::vector<float> v;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        v.push_back((float) atof(item.c_str()));
+    return v;
+}
+
+// <path>\n<count>\n<x y w h blur expression illumination invalid occlusion pose> x count
+static bool loadWider(const std::string &annotation, const std::string &root, std::vector<Sample> &samples) {
+    std::ifstream in(annotation.c_str());
+    if (!in)
+        return false;
+    std::string path;
+    while (std::getline(in, path)) {
+        if (path.empty())
+            continue;
+        int count = 0;
+        in >> count;
+        Sample sample;
+        sample.file = root + "/" + path;
+        // images without faces still carry one all-zero line
+        for (int i = 0; i < std::max(count, 1); i++) {
+            float x, y, w, h;
+            int blur, expression, illumination, invalid, occlusion, pose;
+            in >> x >> y >> w >> h >> blur >> expression >> illumination >> invalid >> occlusion >> pose;
+            if (i < count && w > 0 && h > 0) {
+                GroundTruth gt = {x, y, x + w - 1, y + h - 1, invalid != 0};
+                sample.faces.push_back(gt);
+            }
+        }
+        in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        if (!in)
+            return false;
+        samples.push_back(sample);
+    }
+    return true;
+}
+
+// <path without .jpg>\n<count>\n<major_radius minor_radius angle center_x center_y 1> x count
+static bool loadFddb(const std::string &annotation, const std::string &root, std::vector<Sample> &samples) {
+    std::ifstream in(annotation.c_str());
+    if (!in)
+        return false;
+    std::string path;
+    while (std::getline(in, path)) {
+        if (path.empty())
+            continue;
+        int count = 0;
+        in >> count;
+        Sample sample;
+        sample.file = root + "/" + path + ".jpg";
+        for (int i = 0; i < count; i++) {
+            double ra, rb, angle, cx, cy;
+            int one;
+            in >> ra >> rb >> angle >> cx >> cy >> one;
+            // bounding rectangle of the rotated ellipse
+            const double hw = sqrt(ra * ra * sin(angle) * sin(angle) + rb * rb * cos(angle) * cos(angle));
+            const double hh = sqrt(ra * ra * cos(angle) * cos(angle) + rb * rb * sin(angle) * sin(angle));
+            GroundTruth gt = {(float) (cx - hw), (float) (cy - hh), (float) (cx + hw), (float) (cy + hh), false};
+            sample.faces.push_back(gt);
+        }
+        in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        if (!in)
+            return false;
+        samples.push_back(sample);
+    }
+    return true;
+}
+
+static float iou(const Bbox &a, const GroundTruth &b) {
+    float w = std::min<float>(a.x2, b.x2) - std::max<float>(a.x1, b.x1) + 1;
+    float h = std::min<float>(a.y2, b.y2) - std::max<float>(a.y1, b.y1) + 1;
+    if (w <= 0 || h <= 0)
+        return 0.f;
+    float inter = w * h;
+    float area_a = (a.x2 - a.x1 + 1) * (a.y2 - a.y1 + 1);
+    float area_b = (b.x2 - b.x1 + 1) * (b.y2 - b.y1 + 1);
+    return inter / (area_a + area_b - inter);
+}
+
+// greedy matching in score order, each ground truth face takes at most one detection
+static void match(std::vector<Bbox> boxes, const std::vector<GroundTruth> &faces, float min_iou, EvalResult &result) {
+    std::sort(boxes.begin(), boxes.end(), [](const Bbox &a, const Bbox &b) { return a.score > b.score; });
+    std::vector<bool> used(faces.size(), false);
+    for (const auto &gt : faces)
+        result.positives += gt.ignore ? 0 : 1;
+    for (const auto &box : boxes) {
+        int best = -1;
+        float best_iou = min_iou;
+        for (size_t j = 0; j < faces.size(); j++) {
+            float o = used[j] ? 0.f : iou(box, faces[j]);
+            if (o >= best_iou) {
+                best_iou = o;
+                best = (int) j;
+            }
+        }
+        if (best >= 0 && faces[best].ignore)
+            continue;
+        const bool tp = best >= 0;
+        if (tp)
+            used[best] = true;
+        result.detections.push_back(std::make_pair(box.score, tp));
+        tp ? result.true_pos++ : result.false_pos++;
+    }
+}
+
+static double averagePrecision(std::vector<std::pair<float, bool> > detections, int positives) {
+    if (positives == 0 || detections.empty())
+        return 0.0;
+    std::sort(detections.begin(), detections.end(),
+              [](const std::pair<float, bool> &a, const std::pair<float, bool> &b) { return a.first > b.first; });
+    std::vector<double> precision, recall;
+    int tp = 0;
+    for (size_t i = 0; i < detections.size(); i++) {
+        tp += detections[i].second ? 1 : 0;
+        precision.push_back((double) tp / (i + 1));
+        recall.push_back((double) tp / positives);
+    }
+    for (int i = (int) precision.size() - 2; i >= 0; i--)
+        precision[i] = std::max(precision[i], precision[i + 1]);
+    double ap = 0.0, prev_recall = 0.0;
+    for (size_t i = 0; i < precision.size(); i++) {
+        ap += (recall[i] - prev_recall) * precision[i];
+        prev_recall = recall[i];
+    }
+    return ap;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        printf("usage: %s model_path image_root annotation_file [--format wider|fddb] [--minsizes N,...]\n"
+               "       [--factors F,...] [--pnet-thresholds T,...] [--thresholds P,R,O] [--iou T] [--min-face N]\n"
+               "       [--limit N] [--fused] [--csv file.csv]\n", argv[0]);
+        return 0;
+    }
+    std::string format = "wider", csv;
+    std::vector<float> minsizes = {40}, factors = {0.709f}, pnet_thresholds, thresholds = {0.8f, 0.8f, 0.6f};
+    float min_iou = 0.5f;
+    int min_face = 0, limit = -1;
+    bool fused = false;
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--format" && has_value) {
+            format = argv[++i];
+        } else if (arg == "--minsizes" && has_value) {
+            minsizes = parseFloats(argv[++i]);
+        } else if (arg == "--factors" && has_value) {
+            factors = parseFloats(argv[++i]);
+        } else if (arg == "--pnet-thresholds" && has_value) {
+            pnet_thresholds = parseFloats(argv[++i]);
+        } else if (arg == "--thresholds" && has_value) {
+            thresholds = parseFloats(argv[++i]);
+        } else if (arg == "--iou" && has_value) {
+            min_iou = (float) atof(argv[++i]);
+        } else if (arg == "--min-face" && has_value) {
+            min_face = atoi(argv[++i]);
+        } else if (arg == "--limit" && has_value) {
+            limit = atoi(argv[++i]);
+        } else if (arg == "--csv" && has_value) {
+            csv = argv[++i];
+        } else if (arg == "--fused") {
+            fused = true;
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return -1;
+        }
+    }
+    if (thresholds.size() != 3) {
+        fprintf(stderr, "--thresholds needs three values\n");
+        return -1;
+    }
+    if (pnet_thresholds.empty())
+        pnet_thresholds.push_back(thresholds[0]);
+
+    std::vector<Sample> samples;
+    bool loaded = format == "fddb" ? loadFddb(argv[3], argv[2], samples) : loadWider(argv[3], argv[2], samples);
+    if (!loaded) {
+        fprintf(stderr, "read %s annotations %s failed\n", format.c_str(), argv[3]);
+        return -1;
+    }
+    if (limit >= 0 && (int) samples.size() > limit)
+        samples.resize(limit);
+    for (auto &sample : samples) {
+        for (auto &gt : sample.faces)
+            gt.ignore = gt.ignore || gt.x2 - gt.x1 + 1 < min_face;
+    }
+
+    std::vector<EvalConfig> configs;
+    for (float minsize : minsizes) {
+        for (float factor : factors) {
+            for (float pnet : pnet_thresholds) {
+                EvalConfig cfg = {(int) minsize, factor, {pnet, thresholds[1], thresholds[2]}};
+                configs.push_back(cfg);
+            }
+        }
+    }
+
+    MTCNN mtcnn(argv[1]);
+    if (fused && !(mtcnn.SetFusedPNet(true) && mtcnn.SetFusedRONet(true)))
+        fprintf(stderr, "fused kernels unavailable, evaluating ncnn\n");
+    std::vector<EvalResult> results(configs.size());
+    int evaluated = 0;
+    for (const auto &sample : samples) {
+        int w = 0, h = 0, c = 0;
+        unsigned char *pixels = stbi_load(sample.file.c_str(), &w, &h, &c, 3);
+        if (pixels == NULL) {
+            fprintf(stderr, "load %s failed, skipped\n", sample.file.c_str());
+            continue;
+        }
+        ncnn::Mat rgb = ncnn::Mat::from_pixels(pixels, ncnn::Mat::PIXEL_RGB, w, h);
+        stbi_image_free(pixels);
+        for (size_t k = 0; k < configs.size(); k++) {
+            const EvalConfig &cfg = configs[k];
+            mtcnn.SetMinFace(cfg.minsize);
+            mtcnn.SetScaleFactor(cfg.factor);
+            mtcnn.SetThreshold(cfg.threshold[0], cfg.threshold[1], cfg.threshold[2]);
+            ncnn::Mat img = rgb.clone();
+            std::vector<Bbox> boxes;
+            double start = now();
+            mtcnn.detect(img, boxes);
+            results[k].latency.push_back(calcElapsed(start, now()) * 1000);
+            match(boxes, sample.faces, min_iou, results[k]);
+        }
+        evaluated++;
+    }
+
+    FILE *fp = NULL;
+    if (!csv.empty() && (fp = fopen(csv.c_str(), "wb")) == NULL) {
+        fprintf(stderr, "open %s failed\n", csv.c_str());
+        return -1;
+    }
+    if (fp)
+        fprintf(fp, "minsize,factor,pnet_threshold,rnet_threshold,onet_threshold,images,faces,detections,"
+                    "true_positives,false_positives,precision,recall,ap,mean_ms,p50_ms,p90_ms,images_per_s\n");
+    printf("images: %d of %d\n", evaluated, (int) samples.size());
+    printf("minsize factor  thresholds        precision recall  AP      mean ms  p90 ms   img/s\n");
+    for (size_t k = 0; k < configs.size(); k++) {
+        const EvalConfig &cfg = configs[k];
+        const EvalResult &r = results[k];
+        std::vector<double> latency = r.latency;
+        std::sort(latency.begin(), latency.end());
+        double total = 0;
+        for (double t : latency)
+            total += t;
+        const int dets = r.true_pos + r.false_pos;
+        const double precision = dets > 0 ? (double) r.true_pos / dets : 0.0;
+        const double recall = r.positives > 0 ? (double) r.true_pos / r.positives : 0.0;
+        const double ap = averagePrecision(r.detections, r.positives);
+        const double mean = total / std::max<size_t>(1, r.latency.size());
+        const double throughput = total > 0 ? 1000.0 * r.latency.size() / total : 0.0;
+        printf("%7d %6.3f  %.2f/%.2f/%.2f    %.4f    %.4f  %.4f  %7.2f  %7.2f  %6.2f\n", cfg.minsize, cfg.factor,
+               cfg.threshold[0], cfg.threshold[1], cfg.threshold[2], precision, recall, ap, mean,
+               percentile(latency, 90), throughput);
+        if (fp)
+            fprintf(fp, "%d,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.4f,%.4f,%.4f,%.4f\n", cfg.minsize,
+                    cfg.factor, cfg.threshold[0], cfg.threshold[1], cfg.threshold[2], evaluated, r.positives, dets,
+                    r.true_pos, r.false_pos, precision, recall, ap, mean, percentile(latency, 50),
+                    percentile(latency, 90), throughput);
+    }
+    if (fp)
+        fclose(fp);
+    return 0;
+}
@@ -0,0 +1,49 @@
+// Converts det1/det2/det3 to half-precision weight storage.
+//
+//   mtcnn_fp16 <fp32_model_path> <out_model_path>
+//
+// Convolution and InnerProduct weights are written with the ncnn fp16 tag,
+// biases and PReLU slopes stay fp32 as ncnn expects. The output directory can
+// be passed to MTCNN like the fp32 one. ncnn widens the weights to fp32 at
+// load, only the fused R/O-Net kernels (the fast path) keep them in half
+// precision in memory.
+
+#include "ncnn_model.h"
+#include "mat.h"
+#include <math.h>
+#include <algorithm>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("usage: %s fp32_model_path out_model_path\n", argv[0]);
+        return 0;
+    }
+    const std::string in_path = argv[1];
+    const std::string out_path = argv[2];
+    for (int s = 1; s <= 3; s++) {
+        std::string in = in_path + "/det" + std::to_string(s);
+        std::string out = out_path + "/det" + std::to_string(s);
+        ModelFile model;
+        if (!model.load(in + ".param", in + ".bin"))
+            return -1;
+        for (auto &layer : model.layers) {
+            if (!layer.hasWeights())
+                continue;
+            if (layer.storage == WEIGHT_INT8) {
+                fprintf(stderr, "%s: int8 weights can not be stored as fp16\n", layer.name.c_str());
+                return -1;
+            }
+            float max_error = 0.f;
+            for (float w : layer.weight) {
+                float h = ncnn::float16_to_float32(ncnn::float32_to_float16(w));
+                max_error = std::max(max_error, fabsf(h - w));
+            }
+            layer.storage = WEIGHT_FP16;
+            printf("det%d %-10s %7d weights, max rounding error %g\n", s, layer.name.c_str(),
+                   (int) layer.weight.size(), max_error);
+        }
+        if (!model.save(out + ".param", out + ".bin"))
+            return -1;
+    }
+    return 0;
+}
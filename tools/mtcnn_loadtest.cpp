@@ -0,0 +1,109 @@
+// Load generator for mtcnn_daemon.
+//
+//   mtcnn_loadtest <socket_path> <image> [--connections 4] [--requests 50] [--min-face N] [--raw]
+//
+// Every connection sends the same image requests times back to back and the
+// round trip latencies of all connections are reported together.
+
+#include "daemon_protocol.h"
+#include "timing.h"
+#include "tool_utils.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("usage: %s socket_path image [--connections N] [--requests N] [--min-face N] [--raw]\n", argv[0]);
+        return 0;
+    }
+    int connections = 4, requests = 50, min_face = 0;
+    bool raw = false;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--connections" && has_value) {
+            connections = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--requests" && has_value) {
+            requests = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--min-face" && has_value) {
+            min_face = atoi(argv[++i]);
+        } else if (arg == "--raw") {
+            raw = true;
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return -1;
+        }
+    }
+
+    std::vector<unsigned char> payload;
+    int width = 0, height = 0;
+    if (raw) {
+        int channels = 0;
+        unsigned char *pixels = stbi_load(argv[2], &width, &height, &channels, 3);
+        if (pixels)
+            payload.assign(pixels, pixels + width * height * 3);
+        stbi_image_free(pixels);
+    } else {
+        readFile(argv[2], payload);
+    }
+    if (payload.empty()) {
+        fprintf(stderr, "read %s failed\n", argv[2]);
+        return -1;
+    }
+
+    std::vector<std::vector<double> > latency(connections);
+    std::atomic<int> errors(0), faces_total(0);
+    std::vector<std::thread> threads;
+    double start = now();
+    for (int c = 0; c < connections; c++) {
+        threads.emplace_back([&, c]() {
+            int fd = daemonConnect(argv[1]);
+            if (fd < 0) {
+                errors += requests;
+                return;
+            }
+            DaemonResponse response;
+            std::vector<mtcnn_face> faces;
+            for (int r = 0; r < requests; r++) {
+                double t0 = now();
+                if (!daemonDetect(fd, raw ? DAEMON_RGB : DAEMON_ENCODED, payload.data(), (uint32_t) payload.size(),
+                                  width, height, min_face, response, faces)) {
+                    errors += requests - r;
+                    break;
+                }
+                latency[c].push_back(calcElapsed(t0, now()) * 1000);
+                if (response.status != DAEMON_OK)
+                    errors++;
+                faces_total += (int) faces.size();
+            }
+            close(fd);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    double elapsed = calcElapsed(start, now());
+
+    std::vector<double> all;
+    for (const auto &l : latency)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    double sum = 0;
+    for (double l : all)
+        sum += l;
+    printf("connections %d, requests %d, errors %d, faces %d\n", connections, (int) all.size(), errors.load(),
+           faces_total.load());
+    printf("throughput %.2f req/s over %.2f s\n", all.size() / elapsed, elapsed);
+    printf("latency ms: mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", sum / std::max<size_t>(1, all.size()),
+           percentile(all, 50), percentile(all, 90), percentile(all, 99), all.empty() ? 0 : all.back());
+    return errors ? 1 : 0;
+}
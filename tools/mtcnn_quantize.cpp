@@ -0,0 +1,321 @@
+// Offline int8 calibration for det1/det2/det3 and a fp32 vs int8 accuracy report.
+//
+//   mtcnn_quantize calibrate <fp32_model_path> <out_model_path> <image or dir>... [--minsize N] [--method kl|max]
+//   mtcnn_quantize compare <fp32_model_path> <int8_model_path> <image or dir>... [--minsize N]
+//
+// calibrate runs the fp32 cascade over the images, records the input range of
+// every Convolution/InnerProduct layer as seen by the real P/R/O-Net inputs and
+// writes det1/det2/det3 .param/.bin with int8 weights and ncnn int8 scales.
+// The output directory can be passed to MTCNN like the fp32 one.
+
+#include "mtcnn.h"
+#include "ncnn_model.h"
+#include "listdir.h"
+#include "timing.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include <float.h>
+
+static const int NUM_BINS = 2048;
+static const int TARGET_BINS = 128;
+
+struct LayerStats {
+    const ModelLayer *layer;
+    float absmax;
+    std::vector<double> histogram;
+};
+
+struct StageCalibration {
+    ModelFile model;
+    ncnn::Net net;
+    std::vector<LayerStats> stats;
+};
+
+static bool loadStage(const std::string &model_path, int stage, StageCalibration &cal) {
+    std::string base = model_path + "/det" + std::to_string(stage + 1);
+    if (!cal.model.load(base + ".param", base + ".bin"))
+        return false;
+    if (cal.net.load_param((base + ".param").c_str()) != 0 || cal.net.load_model((base + ".bin").c_str()) != 0)
+        return false;
+    for (const auto &layer : cal.model.layers) {
+        if (!layer.hasWeights())
+            continue;
+        if (layer.storage != WEIGHT_FP32) {
+            fprintf(stderr, "%s: calibration needs fp32 weights\n", layer.name.c_str());
+            return false;
+        }
+        LayerStats s = {&layer, 0.f, std::vector<double>(NUM_BINS, 0.0)};
+        cal.stats.push_back(s);
+    }
+    return true;
+}
+
+static void collect(StageCalibration &cal, const ncnn::Mat &in, bool histogram) {
+    ncnn::Extractor ex = cal.net.create_extractor();
+    ex.set_light_mode(false);
+    ex.input("data", in);
+    for (auto &s : cal.stats) {
+        ncnn::Mat blob;
+        ex.extract(s.layer->bottoms[0].c_str(), blob);
+        for (int q = 0; q < blob.c; q++) {
+            const float *p = blob.channel(q);
+            const int size = blob.w * blob.h;
+            if (!histogram) {
+                for (int i = 0; i < size; i++)
+                    s.absmax = std::max(s.absmax, fabsf(p[i]));
+                continue;
+            }
+            const float bin_width = s.absmax / NUM_BINS;
+            if (bin_width <= 0.f)
+                continue;
+            for (int i = 0; i < size; i++) {
+                if (p[i] == 0.f)
+                    continue;
+                int bin = std::min(NUM_BINS - 1, (int) (fabsf(p[i]) / bin_width));
+                s.histogram[bin] += 1.0;
+            }
+        }
+    }
+}
+
+static double klDivergence(const std::vector<double> &p, const std::vector<double> &q) {
+    double sum_p = 0, sum_q = 0;
+    for (size_t i = 0; i < p.size(); i++) {
+        sum_p += p[i];
+        sum_q += q[i];
+    }
+    double kl = 0;
+    for (size_t i = 0; i < p.size(); i++) {
+        if (p[i] <= 0)
+            continue;
+        double pi = p[i] / sum_p;
+        double qi = q[i] > 0 ? q[i] / sum_q : 1e-12;
+        kl += pi * log(pi / qi);
+    }
+    return kl;
+}
+
+// picks the clipping bin that keeps the 128-level quantized histogram closest to the original
+static int klThreshold(const std::vector<double> &hist) {
+    int best = NUM_BINS;
+    double best_kl = DBL_MAX;
+    for (int t = TARGET_BINS; t <= NUM_BINS; t++) {
+        std::vector<double> p(hist.begin(), hist.begin() + t);
+        for (int i = t; i < NUM_BINS; i++)
+            p[t - 1] += hist[i];
+        std::vector<double> q(t, 0.0);
+        for (int b = 0; b < TARGET_BINS; b++) {
+            int start = b * t / TARGET_BINS;
+            int end = (b + 1) * t / TARGET_BINS;
+            double mass = 0;
+            int nonzero = 0;
+            for (int i = start; i < end; i++) {
+                mass += hist[i];
+                nonzero += hist[i] > 0;
+            }
+            for (int i = start; i < end && nonzero; i++) {
+                if (hist[i] > 0)
+                    q[i] = mass / nonzero;
+            }
+        }
+        double kl = klDivergence(p, q);
+        if (kl < best_kl) {
+            best_kl = kl;
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void quantizeLayer(ModelLayer &layer, float bottom_scale) {
+    const int num_output = layer.numOutput();
+    const int size = (int) layer.weight.size() / num_output;
+    layer.weight_scales.resize(num_output);
+    for (int o = 0; o < num_output; o++) {
+        float *w = &layer.weight[o * size];
+        float absmax = 0.f;
+        for (int i = 0; i < size; i++)
+            absmax = std::max(absmax, fabsf(w[i]));
+        float scale = absmax > 0.f ? 127.f / absmax : 0.f;
+        layer.weight_scales[o] = scale;
+        for (int i = 0; i < size; i++)
+            w[i] = std::max(-127.f, std::min(127.f, roundf(w[i] * scale)));
+    }
+    layer.bottom_scale = bottom_scale;
+    layer.storage = WEIGHT_INT8;
+    layer.setParam(8, "2");
+}
+
+static bool loadImage(const std::string &file, ncnn::Mat &img) {
+    int w = 0, h = 0, c = 0;
+    unsigned char *pixels = stbi_load(file.c_str(), &w, &h, &c, 3);
+    if (pixels == NULL) {
+        fprintf(stderr, "load %s failed\n", file.c_str());
+        return false;
+    }
+    img = ncnn::Mat::from_pixels(pixels, ncnn::Mat::PIXEL_RGB, w, h);
+    stbi_image_free(pixels);
+    return true;
+}
+
+static int calibrate(const std::string &fp32_path, const std::string &out_path,
+                     const std::vector<std::string> &images, int minsize, bool use_kl) {
+    StageCalibration cal[3];
+    for (int s = 0; s < 3; s++) {
+        if (!loadStage(fp32_path, s, cal[s]))
+            return -1;
+    }
+    MTCNN mtcnn(fp32_path);
+    mtcnn.SetMinFace(minsize);
+    int samples[3] = {0, 0, 0};
+    for (int pass = 0; pass < (use_kl ? 2 : 1); pass++) {
+        bool histogram = pass == 1;
+        mtcnn.SetInputHook([&](int stage, const ncnn::Mat &in) {
+            collect(cal[stage], in, histogram);
+            if (!histogram)
+                samples[stage]++;
+        });
+        for (const auto &file : images) {
+            ncnn::Mat img;
+            if (!loadImage(file, img))
+                continue;
+            std::vector<Bbox> boxes;
+            mtcnn.detect(img, boxes);
+        }
+    }
+    printf("calibration samples: pnet %d, rnet %d, onet %d\n", samples[0], samples[1], samples[2]);
+
+    for (int s = 0; s < 3; s++) {
+        ModelFile quantized = cal[s].model;
+        for (const auto &stat : cal[s].stats) {
+            float threshold = stat.absmax;
+            if (use_kl && stat.absmax > 0.f)
+                threshold = (klThreshold(stat.histogram) + 0.5f) * stat.absmax / NUM_BINS;
+            float bottom_scale = threshold > 0.f ? 127.f / threshold : 1.f;
+            for (auto &layer : quantized.layers) {
+                if (layer.name == stat.layer->name)
+                    quantizeLayer(layer, bottom_scale);
+            }
+            printf("det%d %-10s absmax %9.4f threshold %9.4f scale %9.4f\n", s + 1, stat.layer->name.c_str(),
+                   stat.absmax, threshold, bottom_scale);
+        }
+        std::string base = out_path + "/det" + std::to_string(s + 1);
+        if (!quantized.save(base + ".param", base + ".bin"))
+            return -1;
+    }
+    return 0;
+}
+
+static float iou(const Bbox &a, const Bbox &b) {
+    float w = std::min(a.x2, b.x2) - std::max(a.x1, b.x1) + 1;
+    float h = std::min(a.y2, b.y2) - std::max(a.y1, b.y1) + 1;
+    if (w <= 0 || h <= 0)
+        return 0.f;
+    float inter = w * h;
+    float area_a = (a.x2 - a.x1 + 1) * (a.y2 - a.y1 + 1);
+    float area_b = (b.x2 - b.x1 + 1) * (b.y2 - b.y1 + 1);
+    return inter / (area_a + area_b - inter);
+}
+
+static int compare(const std::string &fp32_path, const std::string &int8_path,
+                   const std::vector<std::string> &images, int minsize) {
+    MTCNN reference(fp32_path);
+    MTCNN quantized(int8_path);
+    reference.SetMinFace(minsize);
+    quantized.SetMinFace(minsize);
+    int total_ref = 0, total_q = 0, total_matched = 0;
+    double sum_iou = 0, sum_landmark = 0, max_landmark = 0, sum_score = 0;
+    double time_ref = 0, time_q = 0;
+    for (const auto &file : images) {
+        ncnn::Mat img_ref, img_q;
+        if (!loadImage(file, img_ref))
+            continue;
+        img_q = img_ref.clone();
+        std::vector<Bbox> ref, q;
+        double start = now();
+        reference.detect(img_ref, ref);
+        double mid = now();
+        quantized.detect(img_q, q);
+        time_ref += calcElapsed(start, mid);
+        time_q += calcElapsed(mid, now());
+
+        std::vector<bool> used(q.size(), false);
+        int matched = 0;
+        for (const auto &r : ref) {
+            int best = -1;
+            float best_iou = 0.5f;
+            for (size_t j = 0; j < q.size(); j++) {
+                float o = used[j] ? 0.f : iou(r, q[j]);
+                if (o >= best_iou) {
+                    best_iou = o;
+                    best = (int) j;
+                }
+            }
+            if (best < 0)
+                continue;
+            used[best] = true;
+            matched++;
+            sum_iou += best_iou;
+            sum_score += fabsf(r.score - q[best].score);
+            // landmark drift in percent of the face width
+            float face = std::max(1, r.x2 - r.x1);
+            for (int k = 0; k < 5; k++) {
+                float dx = r.ppoint[k] - q[best].ppoint[k];
+                float dy = r.ppoint[k + 5] - q[best].ppoint[k + 5];
+                double d = 100.0 * sqrt(dx * dx + dy * dy) / face;
+                sum_landmark += d / 5;
+                max_landmark = std::max(max_landmark, d);
+            }
+        }
+        printf("%s: fp32 %d, int8 %d, matched %d\n", file.c_str(), (int) ref.size(), (int) q.size(), matched);
+        total_ref += (int) ref.size();
+        total_q += (int) q.size();
+        total_matched += matched;
+    }
+    int n = std::max(1, total_matched);
+    printf("images: %d\n", (int) images.size());
+    printf("faces: fp32 %d, int8 %d, matched %d (recall vs fp32 %.2f%%, precision vs fp32 %.2f%%)\n",
+           total_ref, total_q, total_matched, 100.0 * total_matched / std::max(1, total_ref),
+           100.0 * total_matched / std::max(1, total_q));
+    printf("matched: mean iou %.4f, mean score diff %.4f, landmark drift mean %.2f%% max %.2f%% of face width\n",
+           sum_iou / n, sum_score / n, sum_landmark / n, max_landmark);
+    printf("time: fp32 %.2f ms, int8 %.2f ms per image\n", 1000 * time_ref / std::max<size_t>(1, images.size()),
+           1000 * time_q / std::max<size_t>(1, images.size()));
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        printf("usage: %s calibrate fp32_model_path out_model_path image_or_dir... [--minsize N] [--method kl|max]\n",
+               argv[0]);
+        printf("       %s compare fp32_model_path int8_model_path image_or_dir... [--minsize N]\n", argv[0]);
+        return 0;
+    }
+    std::string mode = argv[1];
+    int minsize = 40;
+    bool use_kl = true;
+    std::vector<std::string> inputs;
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--minsize" && i + 1 < argc)
+            minsize = atoi(argv[++i]);
+        else if (arg == "--method" && i + 1 < argc)
+            use_kl = std::string(argv[++i]) != "max";
+        else
+            inputs.push_back(arg);
+    }
+    std::vector<std::string> images = listImages(inputs);
+    if (images.empty()) {
+        fprintf(stderr, "no images\n");
+        return -1;
+    }
+    if (mode == "calibrate")
+        return calibrate(argv[2], argv[3], images, minsize, use_kl);
+    if (mode == "compare")
+        return compare(argv[2], argv[3], images, minsize);
+    fprintf(stderr, "unknown mode %s\n", mode.c_str());
+    return -1;
+}
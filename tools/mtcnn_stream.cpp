@@ -0,0 +1,289 @@
+// Runs the detector on a video stream and prints one JSON line per frame.
+//
+//   mtcnn_stream <model_path> [input|-] [--format y4m|rgb24|nv12|i420] [--size WxH]
+//                [--min-face 40] [--ring 4] [--drop] [--fast] [--results file|-] [--output json|binary]
+//
+// Input is a Y4M stream (4:2:0, 4:4:4 or mono) or headerless raw frames of
+// --size, from a file or stdin, e.g.
+//
+//   ffmpeg -i video.mp4 -f yuv4mpegpipe -pix_fmt yuv420p - | mtcnn_stream ../models
+//
+// A reader thread fills a ring of preallocated frame buffers while the
+// detector works on the previous frame, --drop skips the oldest queued frames
+// instead of stalling the reader when detection can not keep up.
+
+#include "mtcnn_c.h"
+#include "frame_ring.h"
+#include "pixel_convert.h"
+#include "result_writer.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+enum FrameFormat {
+    FORMAT_RGB24, FORMAT_I420, FORMAT_NV12, FORMAT_I444, FORMAT_GRAY
+};
+
+struct StreamInfo {
+    FrameFormat format = FORMAT_I420;
+    int width = 0, height = 0;
+    int fps_num = 0, fps_den = 1;
+    bool full_range = false;
+    bool y4m = false;
+};
+
+static size_t frameBytes(const StreamInfo &info) {
+    size_t luma = (size_t) info.width * info.height;
+    size_t chroma = (size_t) ((info.width + 1) / 2) * ((info.height + 1) / 2);
+    switch (info.format) {
+        case FORMAT_RGB24:
+        case FORMAT_I444:
+            return luma * 3;
+        case FORMAT_I420:
+        case FORMAT_NV12:
+            return luma + chroma * 2;
+        default:
+            return luma;
+    }
+}
+
+// reads one header line, without the newline
+static bool readLine(FILE *fp, char *line, size_t size) {
+    size_t n = 0;
+    int c;
+    while ((c = fgetc(fp)) != EOF && c != '\n') {
+        if (n + 1 < size)
+            line[n++] = (char) c;
+    }
+    line[n] = 0;
+    return c == '\n';
+}
+
+static bool parseY4MHeader(FILE *fp, StreamInfo &info) {
+    char line[1024];
+    if (!readLine(fp, line, sizeof(line)) || strncmp(line, "YUV4MPEG2", 9) != 0)
+        return false;
+    info.y4m = true;
+    info.format = FORMAT_I420;
+    for (char *token = strtok(line + 9, " "); token; token = strtok(NULL, " ")) {
+        switch (token[0]) {
+            case 'W':
+                info.width = atoi(token + 1);
+                break;
+            case 'H':
+                info.height = atoi(token + 1);
+                break;
+            case 'F':
+                if (sscanf(token + 1, "%d:%d", &info.fps_num, &info.fps_den) != 2 || info.fps_den <= 0)
+                    info.fps_num = 0;
+                break;
+            case 'C':
+                // 420, 420jpeg, 420mpeg2 and 420paldv only differ in chroma siting
+                if (strncmp(token + 1, "420", 3) == 0)
+                    info.format = FORMAT_I420;
+                else if (strcmp(token + 1, "444") == 0)
+                    info.format = FORMAT_I444;
+                else if (strcmp(token + 1, "mono") == 0)
+                    info.format = FORMAT_GRAY;
+                else {
+                    fprintf(stderr, "unsupported y4m colorspace %s\n", token + 1);
+                    return false;
+                }
+                break;
+            case 'X':
+                // only honoured for 4:4:4 and mono, the detector reads 4:2:0 as limited range
+                if (strcmp(token, "XCOLORRANGE=FULL") == 0)
+                    info.full_range = true;
+                break;
+            default:
+                break;
+        }
+    }
+    return info.width > 0 && info.height > 0;
+}
+
+// I444 and gray frames, the detector reads the other formats directly
+static void toRgb(const StreamInfo &info, const unsigned char *frame, unsigned char *rgb) {
+    const size_t pixels = (size_t) info.width * info.height;
+    const YuvCoeffs &coeffs = info.full_range ? BT601_FULL : BT601_LIMITED;
+    const bool gray = info.format != FORMAT_I444;
+    const unsigned char *u = gray ? NULL : frame + pixels, *v = gray ? NULL : frame + 2 * pixels;
+    for (size_t i = 0; i < pixels; i++, rgb += 3) {
+        float out[3];
+        yuvToRgb(coeffs, frame[i], gray ? 0.f : u[i] - 128.f, gray ? 0.f : v[i] - 128.f, out);
+        rgb[0] = toByte(out[0]);
+        rgb[1] = toByte(out[1]);
+        rgb[2] = toByte(out[2]);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s model_path [input|-] [--format y4m|rgb24|nv12|i420] [--size WxH] [--min-face N]\n"
+               "       [--ring N] [--drop] [--fast] [--results file|-] [--output json|binary]\n", argv[0]);
+        return 0;
+    }
+    const char *input = "-";
+    std::string format = "y4m";
+    StreamInfo info;
+    int min_face = 40, ring_slots = 4;
+    bool drop = false, fast = false;
+    const char *results_file = "-";
+    ResultFormat results_format = RESULT_JSON;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--format" && has_value) {
+            format = argv[++i];
+        } else if (arg == "--size" && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &info.width, &info.height) != 2)
+                info.width = info.height = 0;
+        } else if (arg == "--min-face" && has_value) {
+            min_face = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--ring" && has_value) {
+            ring_slots = std::max(2, atoi(argv[++i]));
+        } else if (arg == "--drop") {
+            drop = true;
+        } else if (arg == "--fast") {
+            fast = true;
+        } else if (arg == "--results" && has_value) {
+            results_file = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            if (!parseResultFormat(argv[++i], results_format)) {
+                fprintf(stderr, "unknown output format %s\n", argv[i]);
+                return -1;
+            }
+        } else if (arg[0] != '-' || arg == "-") {
+            input = argv[i];
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return -1;
+        }
+    }
+
+    FILE *fp = stdin;
+    if (strcmp(input, "-") != 0)
+        fp = fopen(input, "rb");
+#if defined(_WIN32)
+    else
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", input);
+        return -1;
+    }
+    if (format == "y4m") {
+        if (!parseY4MHeader(fp, info)) {
+            fprintf(stderr, "%s is not a supported y4m stream\n", input);
+            return -1;
+        }
+    } else {
+        if (format == "rgb24")
+            info.format = FORMAT_RGB24;
+        else if (format == "nv12")
+            info.format = FORMAT_NV12;
+        else if (format == "i420")
+            info.format = FORMAT_I420;
+        else {
+            fprintf(stderr, "unknown format %s\n", format.c_str());
+            return -1;
+        }
+        if (info.width <= 0 || info.height <= 0) {
+            fprintf(stderr, "raw input needs --size WxH\n");
+            return -1;
+        }
+    }
+
+    ResultWriter results;
+    if (!results.open(results_file, results_format)) {
+        fprintf(stderr, "open %s failed\n", results_file);
+        return -1;
+    }
+    mtcnn_detector *detector = mtcnn_create(argv[1]);
+    if (detector == NULL) {
+        fprintf(stderr, "load models from %s failed\n", argv[1]);
+        return -1;
+    }
+    mtcnn_set_min_face(detector, min_face);
+    if (fast)
+        mtcnn_set_fast_path(detector, 1);
+
+    // everything the loop below touches is allocated up front
+    const size_t frame_size = frameBytes(info);
+    FrameRing ring(ring_slots, frame_size);
+    std::vector<unsigned char> rgb;
+    if (info.format == FORMAT_I444 || info.format == FORMAT_GRAY)
+        rgb.resize((size_t) info.width * info.height * 3);
+    std::vector<mtcnn_face> faces(256);
+
+    std::thread reader([&]() {
+        char line[256];
+        for (int64_t index = 0;; index++) {
+            unsigned char *slot = ring.acquireWrite(drop);
+            if (slot == NULL)
+                break;
+            if (info.y4m && (!readLine(fp, line, sizeof(line)) || strncmp(line, "FRAME", 5) != 0))
+                break;
+            if (fread(slot, 1, frame_size, fp) != frame_size)
+                break;
+            ring.commitWrite(index);
+        }
+        ring.close();
+    });
+
+    int64_t index, frames = 0;
+    double total_ms = 0;
+    const unsigned char *frame;
+    const int w = info.width, h = info.height;
+    const size_t luma = (size_t) w * h, chroma = (size_t) ((w + 1) / 2) * ((h + 1) / 2);
+    while ((frame = ring.acquireRead(index)) != NULL) {
+        // NV12, I420 and RGB are read in place, the slot is held until detect returns
+        double start = now();
+        int found;
+        if (info.format == FORMAT_NV12) {
+            found = mtcnn_detect_nv12(detector, frame, 0, frame + luma, 0, w, h, faces.data(), (int) faces.size());
+        } else if (info.format == FORMAT_I420) {
+            found = mtcnn_detect_i420(detector, frame, 0, frame + luma, 0, frame + luma + chroma, 0, w, h,
+                                      faces.data(), (int) faces.size());
+        } else if (info.format == FORMAT_RGB24) {
+            found = mtcnn_detect_rgb(detector, frame, w, h, 0, faces.data(), (int) faces.size());
+        } else {
+            toRgb(info, frame, rgb.data());
+            start = now();
+            found = mtcnn_detect_rgb(detector, rgb.data(), w, h, 0, faces.data(), (int) faces.size());
+        }
+        double detect_ms = calcElapsed(start, now()) * 1000;
+        ring.releaseRead();
+        total_ms += detect_ms;
+        frames++;
+        ResultInfo result;
+        result.index = index;
+        if (info.fps_num > 0)
+            result.time = (double) index * info.fps_den / info.fps_num;
+        result.width = w;
+        result.height = h;
+        result.detect_ms = detect_ms;
+        if (found < 0)
+            result.error = "detect failed";
+        results.write(result, faces.data(), std::min(std::max(found, 0), (int) faces.size()));
+        // downstream readers see every frame as soon as it is done
+        results.flush();
+    }
+    reader.join();
+    results.close();
+    if (fp != stdin)
+        fclose(fp);
+    mtcnn_destroy(detector);
+    fprintf(stderr, "%lld frames, %d dropped, %.2f ms per frame\n", (long long) frames, (int) ring.dropped(),
+            frames ? total_ms / frames : 0.0);
+    return 0;
+}
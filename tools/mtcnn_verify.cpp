@@ -0,0 +1,336 @@
+// Checks the optimized detection paths against the reference cascade.
+//
+//   mtcnn_verify <model_path> <sample_image> <golden_file> [--write] [--box-tol 2] [--point-tol 2] [--score-tol 0.01]
+//
+// The reference is the default ncnn cascade (scalar generateBbox/nms/refine,
+// per-box RNet/ONet). Its boxes for sample_image at minsize 40 must match the
+// checked-in golden file, then every optimized mode must match the reference
+// on sample_image and on images generated from it (flipped, rescaled, cropped)
+// at several minsize values. The view modes feed the same images through
+// ImageView: packed RGB, BGRA with padded rows, and NV12. The NV12 path never
+// rounds to bytes, so its reference runs on the unrounded float RGB the frame
+// decodes to (the cascade moves borderline faces on +-0.5 noise). --write
+// regenerates the golden file instead.
+// Exits with 1 on any mismatch.
+
+#include "mtcnn.h"
+#include "pixel_convert.h"
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+
+struct Tolerance {
+    float box = 2.f;
+    float point = 2.f;
+    float score = 0.01f;
+};
+
+// how a mode hands the image to the detector
+enum Input {
+    INPUT_MAT,
+    INPUT_RGB_VIEW,
+    INPUT_BGRA_VIEW,
+    INPUT_NV12_VIEW
+};
+
+struct Mode {
+    const char *name;
+    bool fused_pnet, fused_ronet, canvas;
+    Input input;
+};
+
+// packed RGB
+struct TestImage {
+    std::string name;
+    std::vector<unsigned char> pixels;
+    int w, h;
+};
+
+struct Nv12Image {
+    std::vector<unsigned char> y, uv;
+    int y_stride, uv_stride;
+};
+
+static bool sameFace(const Bbox &a, const Bbox &b, const Tolerance &tol) {
+    if (fabsf(a.x1 - b.x1) > tol.box || fabsf(a.y1 - b.y1) > tol.box || fabsf(a.x2 - b.x2) > tol.box
+        || fabsf(a.y2 - b.y2) > tol.box || fabsf(a.score - b.score) > tol.score)
+        return false;
+    for (int k = 0; k < 10; k++) {
+        if (fabsf(a.ppoint[k] - b.ppoint[k]) > tol.point)
+            return false;
+    }
+    return true;
+}
+
+// every expected face needs a distinct counterpart, order does not matter
+static int compareFaces(const std::vector<Bbox> &expected, const std::vector<Bbox> &actual, const Tolerance &tol,
+                        const std::string &what) {
+    int failures = 0;
+    if (expected.size() != actual.size()) {
+        printf("FAIL %s: %d faces, expected %d\n", what.c_str(), (int) actual.size(), (int) expected.size());
+        failures++;
+    }
+    std::vector<bool> used(actual.size(), false);
+    for (const auto &e : expected) {
+        bool found = false;
+        for (size_t j = 0; j < actual.size() && !found; j++) {
+            if (!used[j] && sameFace(e, actual[j], tol))
+                used[j] = found = true;
+        }
+        if (!found) {
+            printf("FAIL %s: no match for face %d %d %d %d score %.4f\n", what.c_str(), e.x1, e.y1, e.x2, e.y2,
+                   e.score);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static bool readGolden(const char *file, std::vector<Bbox> &faces) {
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL)
+        return false;
+    Bbox b;
+    memset(&b, 0, sizeof(b));
+    while (fscanf(fp, "%d %d %d %d %f", &b.x1, &b.y1, &b.x2, &b.y2, &b.score) == 5) {
+        for (int k = 0; k < 10; k++) {
+            if (fscanf(fp, "%f", &b.ppoint[k]) != 1) {
+                fclose(fp);
+                return false;
+            }
+        }
+        faces.push_back(b);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool writeGolden(const char *file, const std::vector<Bbox> &faces) {
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL)
+        return false;
+    // x1 y1 x2 y2 score, then 5 landmark x and 5 landmark y
+    for (const auto &b : faces) {
+        fprintf(fp, "%d %d %d %d %.6f", b.x1, b.y1, b.x2, b.y2, b.score);
+        for (int k = 0; k < 10; k++)
+            fprintf(fp, " %.3f", b.ppoint[k]);
+        fprintf(fp, "\n");
+    }
+    return fclose(fp) == 0;
+}
+
+static std::vector<TestImage> generateImages(const unsigned char *pixels, int w, int h) {
+    std::vector<TestImage> images;
+    TestImage original = {"sample", std::vector<unsigned char>(pixels, pixels + w * h * 3), w, h};
+    images.push_back(original);
+
+    TestImage mirror = {"flipped", std::vector<unsigned char>(w * h * 3), w, h};
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++)
+            memcpy(&mirror.pixels[(y * w + x) * 3], pixels + (y * w + w - 1 - x) * 3, 3);
+    }
+    images.push_back(mirror);
+
+    // odd sizes exercise the pyramid rounding and the pooling tails
+    const float scales[] = {0.61f, 1.37f};
+    for (float scale : scales) {
+        const int sw = (int) (w * scale) | 1, sh = (int) (h * scale) | 1;
+        TestImage resized = {"scaled " + std::to_string((int) (scale * 100)) + "%",
+                             std::vector<unsigned char>(sw * sh * 3), sw, sh};
+        ncnn::resize_bilinear_c3(pixels, w, h, resized.pixels.data(), sw, sh);
+        images.push_back(resized);
+    }
+
+    const int cw = std::min(w, 641), ch = std::min(h, 479);
+    const int cx = (w - cw) / 3, cy = (h - ch) / 2;
+    TestImage cropped = {"cropped", std::vector<unsigned char>(cw * ch * 3), cw, ch};
+    for (int y = 0; y < ch; y++)
+        memcpy(&cropped.pixels[y * cw * 3], pixels + ((cy + y) * w + cx) * 3, cw * 3);
+    images.push_back(cropped);
+    return images;
+}
+
+// BT.601 limited range, chroma averaged over 2x2. The RGB is compressed to
+// 32..223 first, so the decoded frame stays inside 0..255 and the sampler's
+// clamping after interpolation does not differ from a clamped full frame.
+static Nv12Image toNV12(const TestImage &image) {
+    Nv12Image nv12;
+    const int w = image.w, h = image.h, cw = (w + 1) / 2, ch = (h + 1) / 2;
+    nv12.y_stride = w;
+    nv12.uv_stride = cw * 2;
+    nv12.y.resize(w * h);
+    nv12.uv.resize(nv12.uv_stride * ch);
+    auto rgb = [&](int x, int y, int k) { return 32.f + 0.75f * image.pixels[(y * w + x) * 3 + k]; };
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++)
+            nv12.y[y * w + x] = toByte(16.f + 0.256788f * rgb(x, y, 0) + 0.504129f * rgb(x, y, 1)
+                                       + 0.097906f * rgb(x, y, 2));
+    }
+    for (int y = 0; y < ch; y++) {
+        for (int x = 0; x < cw; x++) {
+            float r = 0, g = 0, b = 0;
+            int n = 0;
+            for (int dy = 0; dy < 2 && y * 2 + dy < h; dy++) {
+                for (int dx = 0; dx < 2 && x * 2 + dx < w; dx++, n++) {
+                    r += rgb(x * 2 + dx, y * 2 + dy, 0);
+                    g += rgb(x * 2 + dx, y * 2 + dy, 1);
+                    b += rgb(x * 2 + dx, y * 2 + dy, 2);
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            nv12.uv[y * nv12.uv_stride + x * 2] = toByte(128.f - 0.148223f * r - 0.290993f * g + 0.439216f * b);
+            nv12.uv[y * nv12.uv_stride + x * 2 + 1] = toByte(128.f + 0.439216f * r - 0.367788f * g - 0.071427f * b);
+        }
+    }
+    return nv12;
+}
+
+// float RGB of an NV12 frame, chroma nearest like the sampler
+static ncnn::Mat decodeNV12(const Nv12Image &nv12, int w, int h) {
+    ncnn::Mat rgb(w, h, 3);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const unsigned char *uv = &nv12.uv[(y >> 1) * nv12.uv_stride + (x >> 1) * 2];
+            float v[3];
+            yuvToRgb(BT601_LIMITED, nv12.y[y * nv12.y_stride + x], uv[0] - 128.f, uv[1] - 128.f, v);
+            for (int k = 0; k < 3; k++)
+                rgb.channel(k)[y * w + x] = clampPixel(v[k]);
+        }
+    }
+    return rgb;
+}
+
+static std::vector<Bbox> detect(MTCNN &mtcnn, const ncnn::Mat &rgb, int minsize) {
+    ncnn::Mat img = rgb.clone();
+    std::vector<Bbox> faces;
+    mtcnn.SetMinFace(minsize);
+    mtcnn.detect(img, faces);
+    return faces;
+}
+
+static std::vector<Bbox> detect(MTCNN &mtcnn, const TestImage &image, int minsize, Input input = INPUT_MAT) {
+    if (input == INPUT_MAT)
+        return detect(mtcnn, ncnn::Mat::from_pixels(image.pixels.data(), ncnn::Mat::PIXEL_RGB, image.w, image.h),
+                      minsize);
+    std::vector<Bbox> faces;
+    mtcnn.SetMinFace(minsize);
+    if (input == INPUT_RGB_VIEW) {
+        mtcnn.detect(ImageView::fromPacked(image.pixels.data(), PIXEL_FORMAT_RGB, image.w, image.h), faces);
+    } else if (input == INPUT_BGRA_VIEW) {
+        // rows padded to a 64 byte multiple plus 64, so a view ignoring the stride reads the wrong pixels
+        const int stride = (image.w * 4 + 63) / 64 * 64 + 64;
+        std::vector<unsigned char> bgra(stride * image.h, 0);
+        for (int y = 0; y < image.h; y++) {
+            for (int x = 0; x < image.w; x++) {
+                const unsigned char *p = &image.pixels[(y * image.w + x) * 3];
+                unsigned char *q = &bgra[y * stride + x * 4];
+                q[0] = p[2];
+                q[1] = p[1];
+                q[2] = p[0];
+                q[3] = 255;
+            }
+        }
+        mtcnn.detect(ImageView::fromPacked(bgra.data(), PIXEL_FORMAT_BGRA, image.w, image.h, stride), faces);
+    } else {
+        const Nv12Image nv12 = toNV12(image);
+        mtcnn.detectNV12(nv12.y.data(), nv12.y_stride, nv12.uv.data(), nv12.uv_stride, image.w, image.h, faces);
+    }
+    return faces;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        printf("usage: %s model_path sample_image golden_file [--write] [--box-tol N] [--point-tol N]"
+               " [--score-tol F]\n", argv[0]);
+        return 0;
+    }
+    Tolerance tol;
+    bool write = false;
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--write") {
+            write = true;
+        } else if (arg == "--box-tol" && has_value) {
+            tol.box = (float) atof(argv[++i]);
+        } else if (arg == "--point-tol" && has_value) {
+            tol.point = (float) atof(argv[++i]);
+        } else if (arg == "--score-tol" && has_value) {
+            tol.score = (float) atof(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return -1;
+        }
+    }
+
+    int w = 0, h = 0, c = 0;
+    unsigned char *pixels = stbi_load(argv[2], &w, &h, &c, 3);
+    if (pixels == NULL) {
+        fprintf(stderr, "load %s failed\n", argv[2]);
+        return -1;
+    }
+    std::vector<TestImage> images = generateImages(pixels, w, h);
+    stbi_image_free(pixels);
+
+    MTCNN reference(argv[1]);
+    std::vector<Bbox> sample_faces = detect(reference, images[0], 40);
+    if (write) {
+        if (!writeGolden(argv[3], sample_faces)) {
+            fprintf(stderr, "write %s failed\n", argv[3]);
+            return -1;
+        }
+        printf("wrote %d faces to %s\n", (int) sample_faces.size(), argv[3]);
+        return 0;
+    }
+    std::vector<Bbox> golden;
+    if (!readGolden(argv[3], golden)) {
+        fprintf(stderr, "read %s failed\n", argv[3]);
+        return -1;
+    }
+    int failures = compareFaces(golden, sample_faces, tol, "reference vs golden");
+
+    const Mode modes[] = {
+            {"fused pnet",  true,  false, false, INPUT_MAT},
+            {"fused ronet", false, true,  false, INPUT_MAT},
+            {"canvas",      false, false, true,  INPUT_MAT},
+            {"all",         true,  true,  true,  INPUT_MAT},
+            {"rgb view",    false, false, false, INPUT_RGB_VIEW},
+            {"bgra view",   false, false, false, INPUT_BGRA_VIEW},
+            {"nv12 view",   false, false, false, INPUT_NV12_VIEW},
+    };
+    const int minsizes[] = {20, 40, 80};
+    std::vector<std::vector<Bbox> > expected, expected_nv12;
+    for (const auto &image : images) {
+        const ncnn::Mat decoded = decodeNV12(toNV12(image), image.w, image.h);
+        for (int minsize : minsizes) {
+            expected.push_back(detect(reference, image, minsize));
+            expected_nv12.push_back(detect(reference, decoded, minsize));
+        }
+    }
+    for (const Mode &mode : modes) {
+        MTCNN optimized(argv[1]);
+        if ((mode.fused_pnet && !optimized.SetFusedPNet(true)) || (mode.fused_ronet && !optimized.SetFusedRONet(true))) {
+            printf("FAIL %s: kernel rejected the model\n", mode.name);
+            failures++;
+            continue;
+        }
+        optimized.SetPyramidCanvas(mode.canvas);
+        int checked = 0, mode_failures = 0;
+        for (const auto &image : images) {
+            for (int minsize : minsizes) {
+                std::string what = std::string(mode.name) + ", " + image.name + ", minsize " + std::to_string(minsize);
+                const std::vector<std::vector<Bbox> > &want = mode.input == INPUT_NV12_VIEW ? expected_nv12 : expected;
+                mode_failures += compareFaces(want[checked], detect(optimized, image, minsize, mode.input), tol, what);
+                checked++;
+            }
+        }
+        printf("%-12s %d runs, %s\n", mode.name, checked, mode_failures ? "FAILED" : "ok");
+        failures += mode_failures;
+    }
+    printf("%s\n", failures ? "FAILED" : "all modes match the reference");
+    return failures ? 1 : 0;
+}